@@ -0,0 +1,551 @@
+#pragma once
+/*
+ * Cache model shared by csim and libcachesim.
+ *
+ * Everything here is static inline, like trace.h, so that every program
+ * gets its own copy of the per-policy access paths; the public interface
+ * for other programs is cachesim.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Cache sets are stored as structure-of-arrays: the tags, replacement state and dirty
+ * flags of a set are contiguous, and its valid flags are a bitmap. Each set's
+ * tag row is padded to a multiple of 4 ways so that the tag matcher can
+ * compare whole vectors; the padding is never marked valid.
+ *
+ * The matcher compares up to 64 ways at a time and returns a bitmask of the
+ * equal ones. An AVX2 or SSE4.1 version is picked at startup when the CPU has
+ * it; CSIM_SIMD=scalar|sse4.1|avx2 in the environment overrides the choice.
+ */
+
+typedef unsigned long long (*tag_match_fn)(const unsigned long long *tags, int n,
+                                           unsigned long long tag);
+
+static inline unsigned long long tag_match_scalar(const unsigned long long *tags, int n,
+                                           unsigned long long tag)
+{
+  unsigned long long mask = 0;
+  for (int i = 0; i < n; ++i)
+    mask |= (unsigned long long)(tags[i] == tag) << i;
+  return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("sse4.1"))) static inline unsigned long long
+tag_match_sse41(const unsigned long long *tags, int n, unsigned long long tag)
+{
+  __m128i key = _mm_set1_epi64x((long long)tag);
+  unsigned long long mask = 0;
+  for (int i = 0; i < n; i += 4)
+  {
+    __m128i lo = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(tags + i)), key);
+    __m128i hi = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(tags + i + 2)), key);
+    unsigned bits = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(lo)) |
+                    ((unsigned)_mm_movemask_pd(_mm_castsi128_pd(hi)) << 2);
+    mask |= (unsigned long long)bits << i;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) static inline unsigned long long
+tag_match_avx2(const unsigned long long *tags, int n, unsigned long long tag)
+{
+  __m256i key = _mm256_set1_epi64x((long long)tag);
+  unsigned long long mask = 0;
+  for (int i = 0; i < n; i += 4)
+  {
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(tags + i)), key);
+    mask |= (unsigned long long)(unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+  }
+  return mask;
+}
+#endif
+
+static inline tag_match_fn select_tag_match(void)
+{
+  const char *force = getenv("CSIM_SIMD");
+  if (force && strcmp(force, "scalar") == 0)
+    return tag_match_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  int want_sse = !force || strcmp(force, "sse4.1") == 0;
+  int want_avx = !force || strcmp(force, "avx2") == 0;
+  if (want_avx && __builtin_cpu_supports("avx2"))
+    return tag_match_avx2;
+  if (want_sse && __builtin_cpu_supports("sse4.1"))
+    return tag_match_sse41;
+#endif
+  return tag_match_scalar;
+}
+
+/*
+ * Replacement policies. Each policy keeps its state in the per-way meta
+ * array of a set:
+ *
+ *   lru      time of last use            fifo   time of fill
+ *   lfu      use count                   random (unused), xorshift victim
+ *   bitplru  MRU bit per way             plru   tree bits in meta[0..E-2]
+ *   srrip    2-bit re-reference prediction value, inserted at 2
+ *   brrip    like srrip, but inserted at 3 except for 1 in 32 fills
+ *
+ * Free ways are always filled first, lowest index first, so the policy only
+ * picks a victim in a full set. cache_access_impl() is instantiated once per
+ * policy with a constant argument, which lets the compiler drop the other
+ * policies from each copy.
+ */
+
+enum
+{
+  POLICY_LRU,
+  POLICY_FIFO,
+  POLICY_RANDOM,
+  POLICY_LFU,
+  POLICY_BITPLRU,
+  POLICY_PLRU,
+  POLICY_SRRIP,
+  POLICY_BRRIP,
+  POLICY_COUNT
+};
+
+static const char *const policy_names[POLICY_COUNT] = {
+    "lru", "fifo", "random", "lfu", "bitplru", "plru", "srrip", "brrip"};
+
+#define RRPV_MAX 3
+
+static inline int parse_policy(const char *name)
+{
+  for (int i = 0; i < POLICY_COUNT; ++i)
+    if (strcmp(name, policy_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+typedef struct cache cache_t;
+typedef int (*cache_access_fn)(cache_t *c, unsigned long long addr, int is_store);
+
+struct cache
+{
+  int s, E, b;
+  int policy;
+  int stride; /* E rounded up to a multiple of 4 */
+  int words;  /* 64-bit valid words per set */
+  unsigned long long *tags;
+  unsigned long long *meta; /* replacement state, see above */
+  unsigned char *dirty;
+  unsigned long long *valid;
+  tag_match_fn match;
+  cache_access_fn access;
+  unsigned long long *rng; /* per-set xorshift state, random and brrip only */
+  unsigned long long use_clock;
+  int latency; /* cycles per lookup, for -H */
+  unsigned long long hits, misses, evictions;
+  unsigned long long dirty_evictions; /* evictions that had to write the line back */
+  unsigned long long last_victim; /* block address of the latest eviction */
+  int last_victim_dirty;
+  unsigned long long last_slot; /* line index (set * stride + way) of the latest access or insert */
+};
+
+enum
+{
+  ACCESS_HIT = 0,
+  ACCESS_MISS = 1,
+  ACCESS_EVICT = 2
+};
+
+/*
+ * Random numbers are drawn from a per-set stream so that the outcome in a
+ * set does not depend on accesses to other sets; this keeps set-sharded
+ * runs identical to serial ones.
+ */
+static inline unsigned long long cache_random(unsigned long long *rng)
+{
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+  return *rng;
+}
+
+/* Points the tree-PLRU bits on the path to way away from it. */
+static inline void plru_touch(unsigned long long *tree, int E, int way)
+{
+  int node = 0;
+  for (int half = E / 2; half > 0; half /= 2)
+  {
+    int right = (way & half) != 0;
+    tree[node] = !right;
+    node = 2 * node + 1 + right;
+  }
+}
+
+static inline void repl_update(cache_t *c, unsigned long long *meta, unsigned long long *rng, int way,
+                               int hit, const int policy)
+{
+  switch (policy)
+  {
+  case POLICY_LRU:
+    meta[way] = c->use_clock++;
+    break;
+  case POLICY_FIFO:
+    if (!hit)
+      meta[way] = c->use_clock++;
+    break;
+  case POLICY_LFU:
+    meta[way] = hit ? meta[way] + 1 : 1;
+    break;
+  case POLICY_BITPLRU:
+  {
+    meta[way] = 1;
+    int all = 1;
+    for (int i = 0; i < c->E; ++i)
+      all &= (int)meta[i];
+    if (all)
+    {
+      for (int i = 0; i < c->E; ++i)
+        meta[i] = 0;
+      meta[way] = 1;
+    }
+    break;
+  }
+  case POLICY_PLRU:
+    plru_touch(meta, c->E, way);
+    break;
+  case POLICY_SRRIP:
+    meta[way] = hit ? 0 : RRPV_MAX - 1;
+    break;
+  case POLICY_BRRIP:
+    meta[way] = hit ? 0 : (cache_random(rng) % 32 == 0 ? RRPV_MAX - 1 : RRPV_MAX);
+    break;
+  default:
+    break;
+  }
+}
+
+static inline int repl_victim(cache_t *c, unsigned long long *meta, unsigned long long *rng, const int policy)
+{
+  int E = c->E;
+  switch (policy)
+  {
+  case POLICY_RANDOM:
+    return (int)(cache_random(rng) % (unsigned long long)E);
+  case POLICY_BITPLRU:
+    for (int i = 0; i < E; ++i)
+      if (!meta[i])
+        return i;
+    return 0;
+  case POLICY_PLRU:
+  {
+    int node = 0, way = 0;
+    for (int half = E / 2; half > 0; half /= 2)
+    {
+      int right = (int)meta[node];
+      way += right ? half : 0;
+      node = 2 * node + 1 + right;
+    }
+    return way;
+  }
+  case POLICY_SRRIP:
+  case POLICY_BRRIP:
+    for (;;)
+    {
+      for (int i = 0; i < E; ++i)
+        if (meta[i] >= RRPV_MAX)
+          return i;
+      for (int i = 0; i < E; ++i)
+        ++meta[i];
+    }
+  default:
+  {
+    /* lru, fifo, lfu: smallest value, lowest way on ties */
+    unsigned long long best = meta[0];
+    int place = 0;
+    for (int i = 1; i < E; ++i)
+    {
+      int smaller = meta[i] < best;
+      best = smaller ? meta[i] : best;
+      place = smaller ? i : place;
+    }
+    return place;
+  }
+  }
+}
+
+/* The arrays of the set that an address maps to. */
+typedef struct
+{
+  unsigned long long set_idx, tag, base;
+  unsigned long long *tags, *meta, *valid, *rng;
+} set_ref_t;
+
+static inline __attribute__((always_inline)) set_ref_t cache_set_of(cache_t *c, unsigned long long addr)
+{
+  set_ref_t r;
+  r.set_idx = (addr >> c->b) & ((1ULL << c->s) - 1);
+  r.tag = addr >> (c->s + c->b);
+  r.base = r.set_idx * (unsigned long long)c->stride;
+  r.tags = &c->tags[r.base];
+  r.meta = &c->meta[r.base];
+  r.valid = &c->valid[r.set_idx * (unsigned long long)c->words];
+  r.rng = c->rng ? &c->rng[r.set_idx] : NULL;
+  return r;
+}
+
+/* Returns the way holding r->tag or -1; *empty_idx gets the first free way, or -1 if the set is full. */
+static inline __attribute__((always_inline)) int cache_find(const cache_t *c, const set_ref_t *r, int *empty_idx)
+{
+  *empty_idx = -1;
+  for (int w = 0; w < c->words; ++w)
+  {
+    int n = c->stride - 64 * w < 64 ? c->stride - 64 * w : 64;
+    unsigned long long m = c->match(r->tags + 64 * w, n, r->tag) & r->valid[w];
+    if (m)
+      return 64 * w + __builtin_ctzll(m);
+    if (*empty_idx == -1 && ~r->valid[w])
+    {
+      int idx = 64 * w + __builtin_ctzll(~r->valid[w]);
+      if (idx < c->E)
+        *empty_idx = idx;
+    }
+  }
+  return -1;
+}
+
+/* Installs r->tag in way place, which is free or the policy's victim. */
+static inline __attribute__((always_inline)) void cache_fill(cache_t *c, const set_ref_t *r, int place,
+                                                             int is_store, const int policy)
+{
+  r->valid[place / 64] |= 1ULL << (place % 64);
+  r->tags[place] = r->tag;
+  repl_update(c, r->meta, r->rng, place, 0, policy);
+  c->dirty[r->base + place] = is_store;
+}
+
+/* Simulates one access, returns ACCESS_HIT or ACCESS_MISS, plus ACCESS_EVICT if a line was replaced. */
+static inline __attribute__((always_inline)) int
+cache_access_impl(cache_t *c, unsigned long long addr, int is_store, const int policy)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  int way = cache_find(c, &r, &empty_idx);
+  if (way != -1)
+  {
+    c->hits++;
+    c->last_slot = r.base + way;
+    repl_update(c, r.meta, r.rng, way, 1, policy);
+    if (is_store)
+      c->dirty[r.base + way] = 1;
+    return ACCESS_HIT;
+  }
+
+  c->misses++;
+  int result = ACCESS_MISS;
+  int place = empty_idx;
+  if (place == -1)
+  {
+    c->evictions++;
+    result |= ACCESS_EVICT;
+    place = repl_victim(c, r.meta, r.rng, policy);
+    c->last_victim = ((r.tags[place] << c->s) | r.set_idx) << c->b;
+    c->last_victim_dirty = c->dirty[r.base + place];
+    c->dirty_evictions += c->last_victim_dirty;
+  }
+  c->last_slot = r.base + place;
+  cache_fill(c, &r, place, is_store, policy);
+  return result;
+}
+
+#define DEFINE_CACHE_ACCESS(name, policy)                                                  \
+  static inline int cache_access_##name(cache_t *c, unsigned long long addr, int is_store) \
+  {                                                                                        \
+    return cache_access_impl(c, addr, is_store, policy);                                   \
+  }
+
+DEFINE_CACHE_ACCESS(lru, POLICY_LRU)
+DEFINE_CACHE_ACCESS(fifo, POLICY_FIFO)
+DEFINE_CACHE_ACCESS(random, POLICY_RANDOM)
+DEFINE_CACHE_ACCESS(lfu, POLICY_LFU)
+DEFINE_CACHE_ACCESS(bitplru, POLICY_BITPLRU)
+DEFINE_CACHE_ACCESS(plru, POLICY_PLRU)
+DEFINE_CACHE_ACCESS(srrip, POLICY_SRRIP)
+DEFINE_CACHE_ACCESS(brrip, POLICY_BRRIP)
+
+static const cache_access_fn cache_access_fns[POLICY_COUNT] = {
+    cache_access_lru, cache_access_fifo, cache_access_random, cache_access_lfu,
+    cache_access_bitplru, cache_access_plru, cache_access_srrip, cache_access_brrip};
+
+static inline int cache_access(cache_t *c, unsigned long long addr, int is_store)
+{
+  return c->access(c, addr, is_store);
+}
+
+/*
+ * Split lookup and fill for multi-level simulation, where a miss is filled
+ * only after the lower levels have been consulted. These dispatch on the
+ * policy at run time.
+ */
+
+/* Counts a hit (updating replacement state) or a miss; does not fill. Returns 1 on a hit. */
+static inline int cache_probe(cache_t *c, unsigned long long addr, int is_store)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  int way = cache_find(c, &r, &empty_idx);
+  if (way == -1)
+  {
+    c->misses++;
+    return 0;
+  }
+  c->hits++;
+  repl_update(c, r.meta, r.rng, way, 1, c->policy);
+  if (is_store)
+    c->dirty[r.base + way] = 1;
+  return 1;
+}
+
+/*
+ * Installs the block of addr without counting an access. If a valid line is
+ * replaced, counts an eviction, stores the victim's block address and dirty
+ * flag and returns 1.
+ */
+static inline int cache_insert(cache_t *c, unsigned long long addr, int dirty, unsigned long long *victim,
+                        int *victim_dirty)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  int way = cache_find(c, &r, &empty_idx);
+  if (way != -1)
+  {
+    c->dirty[r.base + way] |= (unsigned char)dirty;
+    return 0;
+  }
+  int evicted = (empty_idx == -1);
+  int place = evicted ? repl_victim(c, r.meta, r.rng, c->policy) : empty_idx;
+  if (evicted)
+  {
+    c->evictions++;
+    *victim = ((r.tags[place] << c->s) | r.set_idx) << c->b;
+    *victim_dirty = c->dirty[r.base + place];
+    c->dirty_evictions += *victim_dirty;
+  }
+  c->last_slot = r.base + place;
+  cache_fill(c, &r, place, dirty, c->policy);
+  return evicted;
+}
+
+static inline int cache_contains(cache_t *c, unsigned long long addr)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  return cache_find(c, &r, &empty_idx) != -1;
+}
+
+/* Line index (set * stride + way) holding the block of addr, or -1. */
+static inline long long cache_lookup(cache_t *c, unsigned long long addr)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  int way = cache_find(c, &r, &empty_idx);
+  return way == -1 ? -1 : (long long)(r.base + way);
+}
+
+/* Marks the block of addr dirty if present; returns 1 if it was. */
+static inline int cache_mark_dirty(cache_t *c, unsigned long long addr)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  int way = cache_find(c, &r, &empty_idx);
+  if (way == -1)
+    return 0;
+  c->dirty[r.base + way] = 1;
+  return 1;
+}
+
+/* Number of valid lines still holding unwritten data. */
+static inline unsigned long long cache_dirty_lines(const cache_t *c)
+{
+  unsigned long long n = 0;
+  for (unsigned long long set = 0; set < (1ULL << c->s); ++set)
+  {
+    const unsigned long long *valid = &c->valid[set * c->words];
+    for (int way = 0; way < c->E; ++way)
+      n += (valid[way / 64] >> (way % 64)) & c->dirty[set * c->stride + way];
+  }
+  return n;
+}
+
+/* Drops the block of addr if present. Returns 1 and its dirty flag in *was_dirty if it was. */
+static inline int cache_invalidate(cache_t *c, unsigned long long addr, int *was_dirty)
+{
+  set_ref_t r = cache_set_of(c, addr);
+  int empty_idx;
+  int way = cache_find(c, &r, &empty_idx);
+  if (way == -1)
+    return 0;
+  r.valid[way / 64] &= ~(1ULL << (way % 64));
+  if (c->policy != POLICY_PLRU)
+    r.meta[way] = 0;
+  *was_dirty = c->dirty[r.base + way];
+  c->dirty[r.base + way] = 0;
+  return 1;
+}
+
+static inline void cache_free(cache_t *c)
+{
+  free(c->tags);
+  free(c->meta);
+  free(c->dirty);
+  free(c->valid);
+  free(c->rng);
+  c->tags = c->meta = c->valid = c->rng = NULL;
+  c->dirty = NULL;
+}
+
+/* Returns 0 on success, -1 if out of memory, -2 if the policy does not fit E. */
+static inline int cache_init(cache_t *c, int s, int E, int b, int policy, unsigned long long seed)
+{
+  if (policy == POLICY_PLRU && (E & (E - 1)) != 0)
+    return -2;
+  memset(c, 0, sizeof(*c));
+  c->s = s;
+  c->E = E;
+  c->b = b;
+  c->policy = policy;
+  c->stride = (E + 3) & ~3;
+  c->words = (E + 63) / 64;
+  c->use_clock = 1;
+  c->match = select_tag_match();
+  c->access = cache_access_fns[policy];
+  unsigned long long S = 1ULL << s;
+  c->tags = (unsigned long long *)calloc(S * c->stride, sizeof(unsigned long long));
+  c->meta = (unsigned long long *)calloc(S * c->stride, sizeof(unsigned long long));
+  c->dirty = (unsigned char *)calloc(S * c->stride, 1);
+  c->valid = (unsigned long long *)calloc(S * c->words, sizeof(unsigned long long));
+  if (!c->tags || !c->meta || !c->dirty || !c->valid)
+  {
+    cache_free(c);
+    return -1;
+  }
+  if (policy == POLICY_RANDOM || policy == POLICY_BRRIP)
+  {
+    c->rng = (unsigned long long *)malloc(sizeof(unsigned long long) * S);
+    if (!c->rng)
+    {
+      cache_free(c);
+      return -1;
+    }
+    for (unsigned long long i = 0; i < S; ++i)
+    {
+      /* splitmix64 of seed + set index, never zero */
+      unsigned long long z = seed + (i + 1) * 0x9e3779b97f4a7c15ULL;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      z ^= z >> 31;
+      c->rng[i] = z ? z : 1;
+    }
+  }
+  return 0;
+}
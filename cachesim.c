@@ -0,0 +1,99 @@
+/*
+ * libcachesim, the public face of cache.h. See cachesim.h.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "cachesim.h"
+
+_Static_assert((int)CACHESIM_HIT == ACCESS_HIT && (int)CACHESIM_MISS == ACCESS_MISS &&
+                   (int)CACHESIM_EVICT == ACCESS_EVICT,
+               "cachesim.h results must match cache.h");
+
+int cachesim_create(cachesim_t **out, const cachesim_config_t *config)
+{
+  *out = NULL;
+  int policy = config->policy ? parse_policy(config->policy) : POLICY_LRU;
+  if (policy < 0)
+    return CACHESIM_ERR_POLICY;
+  if (config->s < 0 || config->E <= 0 || config->b < 0 || config->s + config->b > 63)
+    return CACHESIM_ERR_GEOMETRY;
+  cache_t *c = (cache_t *)malloc(sizeof(cache_t));
+  if (!c)
+    return CACHESIM_ERR_NOMEM;
+  int err = cache_init(c, config->s, config->E, config->b, policy, config->seed);
+  if (err != 0)
+  {
+    free(c);
+    return err == -2 ? CACHESIM_ERR_WAYS : CACHESIM_ERR_NOMEM;
+  }
+  *out = c;
+  return 0;
+}
+
+const char *cachesim_strerror(int err)
+{
+  switch (err)
+  {
+  case 0:
+    return "success";
+  case CACHESIM_ERR_NOMEM:
+    return "out of memory";
+  case CACHESIM_ERR_GEOMETRY:
+    return "s, E or b out of range";
+  case CACHESIM_ERR_POLICY:
+    return "unknown replacement policy";
+  case CACHESIM_ERR_WAYS:
+    return "plru needs a power-of-two E";
+  default:
+    return "unknown error";
+  }
+}
+
+void cachesim_destroy(cachesim_t *c)
+{
+  if (!c)
+    return;
+  cache_free(c);
+  free(c);
+}
+
+int cachesim_access(cachesim_t *c, unsigned long long addr, int is_store)
+{
+  return cache_access(c, addr, is_store != 0);
+}
+
+unsigned long long cachesim_access_batch(cachesim_t *c, const cachesim_ref_t *refs, size_t n,
+                                         unsigned char *results)
+{
+  unsigned long long misses = c->misses;
+  for (size_t i = 0; i < n; ++i)
+  {
+    char op = refs[i].op;
+    if (op != 'L' && op != 'S' && op != 'M')
+      continue;
+    int result = cache_access(c, refs[i].addr, op != 'L');
+    if (op == 'M')
+      cache_access(c, refs[i].addr, 1);
+    if (results)
+      results[i] = (unsigned char)result;
+  }
+  return c->misses - misses;
+}
+
+void cachesim_get_stats(const cachesim_t *c, cachesim_stats_t *stats)
+{
+  stats->hits = c->hits;
+  stats->misses = c->misses;
+  stats->evictions = c->evictions;
+  stats->dirty_evictions = c->dirty_evictions;
+  stats->dirty_lines = cache_dirty_lines(c);
+}
+
+void cachesim_reset_stats(cachesim_t *c)
+{
+  c->hits = c->misses = c->evictions = c->dirty_evictions = 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+/*
+ * libcachesim: the csim cache model as a C library.
+ *
+ * A cachesim_t is one cache of 2^s sets of E lines of 2^b bytes with one
+ * of csim's replacement policies. It is fed accesses one at a time or in
+ * batches and counts hits, misses and evictions exactly as csim does for
+ * the same configuration and trace; a plain csim run (one -s/-E/-b cache
+ * and no analyses) is itself a client. `make` builds libcachesim.a and
+ * libcachesim.so.
+ *
+ *   cachesim_config_t config = {5, 1, 4, "lru", 1};
+ *   cachesim_t *c;
+ *   if (cachesim_create(&c, &config) == 0)
+ *   {
+ *     cachesim_access(c, 0x1000, 0);
+ *     cachesim_stats_t stats;
+ *     cachesim_get_stats(c, &stats);
+ *     cachesim_destroy(c);
+ *   }
+ *
+ * A cachesim_t must not be used by two threads at once; separate ones are
+ * independent.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cache cachesim_t;
+
+typedef struct
+{
+  int s, E, b;
+  const char *policy;      /* lru (when NULL), fifo, random, lfu, bitplru, plru, srrip, brrip */
+  unsigned long long seed; /* for random and brrip; csim's default is 1 */
+} cachesim_config_t;
+
+typedef struct
+{
+  unsigned long long hits, misses, evictions;
+  unsigned long long dirty_evictions; /* evictions that had to write the line back */
+  unsigned long long dirty_lines;     /* valid lines still holding unwritten data */
+} cachesim_stats_t;
+
+/* One trace record: op is 'L', 'S' or 'M' (a load then a store to addr). */
+typedef struct
+{
+  unsigned long long addr;
+  char op;
+} cachesim_ref_t;
+
+/* Results of an access: a hit, or a miss that may also have evicted a line. */
+enum
+{
+  CACHESIM_HIT = 0,
+  CACHESIM_MISS = 1,
+  CACHESIM_EVICT = 2
+};
+
+/* Errors of cachesim_create. */
+enum
+{
+  CACHESIM_ERR_NOMEM = -1,
+  CACHESIM_ERR_GEOMETRY = -2, /* a negative s or b, an E below 1, or s + b over 63 */
+  CACHESIM_ERR_POLICY = -3,   /* no such policy */
+  CACHESIM_ERR_WAYS = -4      /* plru with an E that is not a power of two */
+};
+
+/* Creates an empty cache in *out. Returns 0 or one of the CACHESIM_ERR codes. */
+int cachesim_create(cachesim_t **out, const cachesim_config_t *config);
+
+/* Describes a cachesim_create result, e.g. for an error message. */
+const char *cachesim_strerror(int err);
+
+void cachesim_destroy(cachesim_t *c);
+
+/* Simulates one load (is_store 0) or store. Returns CACHESIM_HIT or CACHESIM_MISS, plus CACHESIM_EVICT. */
+int cachesim_access(cachesim_t *c, unsigned long long addr, int is_store);
+
+/*
+ * Simulates n records in order. If results is not NULL, results[i] gets
+ * the outcome of refs[i] (for 'M', that of its load; the store always
+ * hits). Records with any other op are skipped and their results left
+ * alone. Returns the number of misses in the batch.
+ */
+unsigned long long cachesim_access_batch(cachesim_t *c, const cachesim_ref_t *refs, size_t n,
+                                         unsigned char *results);
+
+void cachesim_get_stats(const cachesim_t *c, cachesim_stats_t *stats);
+
+/* Zeroes the counters but keeps the lines, e.g. after a warm-up. */
+void cachesim_reset_stats(cachesim_t *c);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <vector>
+#include "trace.h"
 
 #define NDEBUG
 
@@ -917,8 +918,47 @@ inline int get_current_reg_count()
   return current_reg_count;
 }
 
+inline bool binary_log = false;
+
+inline void print_log_binary()
+{
+  unsigned char buf[TRACE_BIN_MAX_REC];
+  trace_bin_header(buf);
+  std::cout.write((const char *)buf, TRACE_BIN_HEADER_LEN);
+  trace_codec_t codec;
+  trace_codec_init(&codec);
+  for (auto &log : ptr_reg::access_logs)
+  {
+    trace_rec_t rec;
+    switch (log.type_)
+    {
+    case MemoryAccessType::READ:
+      rec.op = 'L';
+      break;
+    case MemoryAccessType::WRITE:
+      rec.op = 'S';
+      break;
+    case MemoryAccessType::READ_WRITE:
+      rec.op = 'M';
+      break;
+    default:
+      throw std::runtime_error("unkown memory access type");
+    }
+    rec.addr = (unsigned long long)(log.addr_ - ptr_reg::base + ptr_reg::base_offset);
+    rec.size = 4;
+    rec.reg = log.reg_id_;
+    std::cout.write((const char *)buf, trace_encode(&codec, &rec, buf));
+  }
+  std::cout.flush();
+}
+
 inline void print_log()
 {
+  if (binary_log)
+  {
+    print_log_binary();
+    return;
+  }
   for (auto &log : ptr_reg::access_logs)
   {
     switch (log.type_)
@@ -1,46 +1,3438 @@
 // student id: 2024202848
 // please change the above line to your student id
 
+#define _GNU_SOURCE
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
 
-void printSummary(int hits, int misses, int evictions)
+#include "cache.h"
+#include "cachesim.h"
+#include "stackdist.h"
+#include "trace.h"
+
+void printSummary(unsigned long long hits, unsigned long long misses, unsigned long long evictions)
+{
+  printf("hits:%llu misses:%llu evictions:%llu\n", hits, misses, evictions);
+  FILE *output_fp = fopen(".csim_results", "w");
+  assert(output_fp);
+  fprintf(output_fp, "%llu %llu %llu\n", hits, misses, evictions);
+  fclose(output_fp);
+}
+
+void printHelp(const char *name)
+{
+  printf(
+      "Usage: %s [-hv] [-p <policy>] -s <num> -E <num> -b <num> -t <file>\n"
+      "       %s [-hv] [-p <policy>] -c <s>,<E>,<b> [-c ...] -t <file>\n"
+      "       %s [-hv] [-p <policy>] -H <levels> [-i <inclusion>] [-l <num>] -t <file>\n"
+      "       %s [-hv] -R <checkpoint> [-C <checkpoint>] -t <file>\n"
+      "       %s [-h] [-p <policy>] [-j <num>] -B <manifest> [-F csv|json] [-o <file>]\n"
+      "       %s [-h] [-p <policy>] -X <protocol> [-Q rr|time] -s <num> -E <num> -b <num> -t <file> ...\n"
+      "Options:\n"
+      "  -h         Print this help message.\n"
+      "  -v         Optional verbose flag.\n"
+      "  -g         Report progress and throughput on stderr even when it is\n"
+      "             not a terminal (on a terminal, runs over a second do).\n"
+      "  -s <num>   Number of set index bits.\n"
+      "  -E <num>   Number of lines per set.\n"
+      "  -b <num>   Number of block offset bits.\n"
+      "  -c <list>  Extra cache configurations, simulated in the same pass.\n"
+      "             Repeatable; one argument may hold several separated by\n"
+      "             spaces or ';'.\n"
+      "  -p <name>  Replacement policy: lru (default), fifo, random, lfu,\n"
+      "             bitplru, plru (tree, E must be a power of two), srrip, brrip.\n"
+      "             A -c entry may pick its own as s,E,b,policy.\n"
+      "  -r <num>   Seed for random and brrip (default 1).\n"
+      "  -j <num>   Simulate with num threads, each owning a range of sets\n"
+      "             (at most 64, not with -v).\n"
+      "  -P         Decode the trace on a separate thread and report the\n"
+      "             throughput of both pipeline stages on stderr.\n"
+      "  -S <frac>  Simulate only a hashed frac (0 < frac <= 1) of the sets of\n"
+      "             each configuration, at least two of every group of sets\n"
+      "             with similar access counts early in the trace, and scale\n"
+      "             the counts up, with a 95%% confidence interval (not with\n"
+      "             -j, -P, -v or the analyses; -r seeds the hash).\n"
+      "  -m <num>   Also print the LRU miss ratio curve for E = 1..num, using\n"
+      "             the s and b of the first configuration.\n"
+      "  -H <list>  Simulate a cache hierarchy instead, one s,E,b[,policy][:cycles]\n"
+      "             entry per level starting at L1.\n"
+      "  -i <name>  Hierarchy inclusion policy: nine (default), inclusive,\n"
+      "             exclusive.\n"
+      "  -l <num>   Memory latency in cycles for -H (default 100).\n"
+      "  -W <num>   Extra cycles per write-back to memory for -H (default 0).\n"
+      "  -w         Report dirty evictions and memory traffic in bytes. Lines\n"
+      "             still dirty at the end count as written back.\n"
+      "  -3         Classify the misses of every configuration as compulsory,\n"
+      "             capacity or conflict (not with -j).\n"
+      "  -D         Print a log2 histogram of reuse distances (distinct blocks\n"
+      "             touched between two uses of a block, with the b of the\n"
+      "             first configuration), also per region with -a (not with\n"
+      "             -j).\n"
+      "  -e <file>  Write a binary log with one event per access and\n"
+      "             configuration: hit, miss or eviction and the evicted tag\n"
+      "             (format in csim.c; not with -j).\n"
+      "  -f <spec>  Prefetch into every configuration: next[,degree],\n"
+      "             stride[,degree] (per register id) or\n"
+      "             stream[,buffers[,depth]] (default 4,4). Prefetch hits are\n"
+      "             counted among the hits (not with -j).\n"
+      "  -V <num>   Give every configuration a fully associative victim cache\n"
+      "             of num lines and report the misses it absorbs (not with -j).\n"
+      "  -M <num>   Likewise with a miss cache, which keeps missed lines.\n"
+      "  -T <num>   Print hits, misses and evictions of every window of num\n"
+      "             accesses as CSV; num,ws adds the number of distinct blocks\n"
+      "             touched in the window (not with -j).\n"
+      "  -o <file>  Write the -T rows, or the -B table, to file instead of stdout.\n"
+      "  -a <list>  Break the first configuration's results down by matrix\n"
+      "             region and register id, given m,n,p[,buffer] of the\n"
+      "             printTrace layout (buffer defaults to 64 ints; not with\n"
+      "             -j).\n"
+      "  -C <file>  Save the cache state and trace position to file when the\n"
+      "             run ends; file:num stops after num trace records. SIGINT\n"
+      "             and SIGTERM stop the run and save it too (not with -j, -P,\n"
+      "             -S, -m, -H or the analyses).\n"
+      "  -R <file>  Resume from a checkpoint, on the trace it was taken on. The\n"
+      "             configurations come from the file; the counts include the\n"
+      "             part before it.\n"
+      "  -B <file>  Batch mode: simulate every 'trace <file>' line of the\n"
+      "             manifest under every 'config <s,E,b[,policy]> ...' line, on\n"
+      "             -j threads (default: one per CPU), and print one table.\n"
+      "  -F <fmt>   Table format for -B: csv (default) or json.\n"
+      "  -X <name>  Simulate one -s/-E/-b cache per core, kept coherent by mesi\n"
+      "             or moesi, and report invalidations, coherence and\n"
+      "             false-sharing misses and the lines that caused the most.\n"
+      "             Give one -t per core, or one trace whose records start with\n"
+      "             their core id (\" 1 S 30000040,4\").\n"
+      "  -Q <name>  How -X interleaves several traces: rr (default), one record\n"
+      "             per core in turn, or time, by their @time prefixes.\n"
+      "  -t <file>  Trace file, or - to stream it from stdin (the default when\n"
+      "             stdin is not a terminal). Repeatable with -X.\n\n"
+      "Examples:\n"
+      "  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n"
+      "  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n"
+      "  linux>  %s -c '5,1,5 2,4,3 4,2,4' -t traces/yi.trace\n"
+      "  linux>  %s -s 5 -E 1 -b 4 -m 16 -t traces/yi.trace\n"
+      "  linux>  %s -c '4,4,4,lru 4,4,4,plru 4,4,4,srrip' -t traces/yi.trace\n"
+      "  linux>  %s -H '5,1,4:1 8,4,4:10' -i inclusive -t traces/yi.trace\n"
+      "  linux>  %s -s 5 -E 1 -b 5 -a 32,32,32 -t gemm.trace\n"
+      "  linux>  %s -s 5 -E 1 -b 5 -D -a 32,32,32 -t gemm.trace\n"
+      "  linux>  %s -s 8 -E 4 -b 6 -C warm.ckpt:1000000 -t big.trace\n"
+      "  linux>  %s -R warm.ckpt -t big.trace\n"
+      "  linux>  %s -B sweep.txt -F json -o sweep.json\n"
+      "  linux>  %s -X moesi -s 6 -E 8 -b 6 -t core0.trace -t core1.trace\n"
+      "  linux>  ./printTrace case2 | %s -s 5 -E 1 -b 5\n",
+      name, name, name, name, name, name, name, name, name, name, name, name, name, name, name, name, name, name,
+      name);
+}
+
+/*
+ * Parses "s,E,b[,policy][:latency]" entries separated by spaces or ';' and
+ * appends them to *caches. Entries without a policy get -1 and inherit -p
+ * later; the latency defaults to 1 cycle and only matters for -H.
+ */
+static int parse_configs(const char *arg, cache_t **caches, int *n_caches)
+{
+  const char *p = arg;
+  while (*p)
+  {
+    if (*p == ' ' || *p == ';' || *p == '\t')
+    {
+      ++p;
+      continue;
+    }
+    int s, E, b, used;
+    if (sscanf(p, "%d,%d,%d%n", &s, &E, &b, &used) != 3 || s < 0 || E <= 0 || b < 0)
+      return -1;
+    p += used;
+    int policy = -1;
+    if (*p == ',')
+    {
+      char name[16];
+      size_t len = strcspn(p + 1, " ;\t:");
+      if (len >= sizeof(name))
+        return -1;
+      memcpy(name, p + 1, len);
+      name[len] = '\0';
+      if ((policy = parse_policy(name)) < 0)
+        return -1;
+      p += 1 + len;
+    }
+    int latency = 1;
+    if (*p == ':')
+    {
+      if (sscanf(p + 1, "%d%n", &latency, &used) != 1 || latency < 0)
+        return -1;
+      p += 1 + used;
+    }
+    if (*p && *p != ' ' && *p != ';' && *p != '\t')
+      return -1;
+    cache_t *grown = (cache_t *)realloc(*caches, sizeof(cache_t) * (*n_caches + 1));
+    if (!grown)
+      return -1;
+    *caches = grown;
+    grown[*n_caches].s = s;
+    grown[*n_caches].E = E;
+    grown[*n_caches].b = b;
+    grown[*n_caches].policy = policy;
+    grown[*n_caches].latency = latency;
+    ++*n_caches;
+  }
+  return 0;
+}
+
+/* Stack distance histogram of one (s, b) geometry, truncated at max_E. */
+typedef struct
+{
+  stackdist_t sd;
+  int max_E;
+  unsigned long long *hist; /* hist[d] for d < max_E */
+  unsigned long long accesses;
+} mrc_t;
+
+static int mrc_init(mrc_t *m, int s, int b, int max_E)
+{
+  m->max_E = max_E;
+  m->accesses = 0;
+  m->hist = (unsigned long long *)calloc(max_E, sizeof(unsigned long long));
+  if (!m->hist)
+    return -1;
+  if (stackdist_init(&m->sd, s, b) != 0)
+  {
+    free(m->hist);
+    return -1;
+  }
+  return 0;
+}
+
+static void mrc_free(mrc_t *m)
+{
+  stackdist_free(&m->sd);
+  free(m->hist);
+}
+
+static inline int mrc_access(mrc_t *m, unsigned long long addr)
+{
+  long long d = stackdist_access(&m->sd, addr);
+  if (d == -2)
+    return -1;
+  ++m->accesses;
+  if (d >= 0 && d < m->max_E)
+    ++m->hist[d];
+  return 0;
+}
+
+static void printMissRatioCurve(const mrc_t *m)
+{
+  unsigned long long n_sets = 1ULL << m->sd.s;
+  printf("miss ratio curve (s=%d, b=%d):\n", m->sd.s, m->sd.b);
+  printf("%6s %14s %14s %14s %10s\n", "E", "hits", "misses", "evictions", "miss_ratio");
+  unsigned long long hits = 0;
+  for (int E = 1; E <= m->max_E; ++E)
+  {
+    hits += m->hist[E - 1];
+    unsigned long long misses = m->accesses - hits;
+    /* a set only evicts once all E ways have been filled */
+    unsigned long long fills = 0;
+    for (unsigned long long i = 0; i < n_sets; ++i)
+      fills += m->sd.sets[i].live < (unsigned)E ? m->sd.sets[i].live : (unsigned)E;
+    printf("%6d %14llu %14llu %14llu %10.6f\n", E, hits, misses, misses - fills,
+           m->accesses ? (double)misses / (double)m->accesses : 0.0);
+  }
+}
+
+/*
+ * Progress reporting.
+ *
+ * When stderr is a terminal, or with -g, runs that take longer than a second
+ * report their progress and throughput there about once a second, and sum
+ * up at the end. The clock is only read every PROGRESS_STEP accesses, so
+ * the simulation loops pay one addition per record.
+ */
+
+#define PROGRESS_STEP (1ULL << 20)
+
+typedef struct
+{
+  int enabled, forced, reported;
+  unsigned long long accesses, next;
+  double start, last;
+} progress_t;
+
+static progress_t progress;
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void progress_start(int forced)
+{
+  memset(&progress, 0, sizeof(progress));
+  progress.forced = forced;
+  progress.enabled = forced || isatty(STDERR_FILENO);
+  progress.next = PROGRESS_STEP;
+  progress.start = progress.last = now_seconds();
+}
+
+static void progress_report(const trace_t *trace)
+{
+  progress.next = progress.accesses + PROGRESS_STEP;
+  double now = now_seconds();
+  if (now - progress.last < 1.0)
+    return;
+  progress.last = now;
+  progress.reported = 1;
+  fprintf(stderr, "csim: %.1fM accesses", (double)progress.accesses * 1e-6);
+  double done = trace ? trace_fraction(trace) : -1.0;
+  if (done >= 0.0)
+    fprintf(stderr, ", %.0f%% of the trace", done * 100.0);
+  fprintf(stderr, ", %.2fM accesses/s\n", (double)progress.accesses / (now - progress.start) * 1e-6);
+}
+
+/* Counts accesses; trace, when not NULL, gives the position in the input. */
+static inline void progress_add(const trace_t *trace, unsigned long long accesses)
+{
+  progress.accesses += accesses;
+  if (progress.enabled && progress.accesses >= progress.next)
+    progress_report(trace);
+}
+
+/*
+ * Peak resident set size in KiB, or 0 where /proc is missing. Unlike
+ * getrusage(), VmHWM does not carry over the parent's peak through exec.
+ */
+static unsigned long long peak_rss_kib(void)
+{
+  FILE *fp = fopen("/proc/self/status", "r");
+  if (!fp)
+    return 0;
+  char line[256];
+  unsigned long long kib = 0;
+  while (fgets(line, sizeof(line), fp))
+    if (sscanf(line, "VmHWM: %llu kB", &kib) == 1)
+      break;
+  fclose(fp);
+  return kib;
+}
+
+static void progress_finish(void)
+{
+  if (!progress.forced && !progress.reported)
+    return;
+  double elapsed = now_seconds() - progress.start;
+  fprintf(stderr, "csim: %llu accesses in %.2fs (%.2fM accesses/s, peak RSS %.1f MiB)\n", progress.accesses,
+          elapsed, elapsed > 0 ? (double)progress.accesses / elapsed * 1e-6 : 0.0, (double)peak_rss_kib() / 1024.0);
+}
+
+/*
+ * Set-sharded parallel simulation.
+ *
+ * Sets never interact, so each worker thread owns a contiguous range of the
+ * sets of every configuration and simulates only the accesses that map
+ * there. The reading thread decodes the trace, splits M into its two
+ * accesses and appends each access to the batch of every worker that owns
+ * its set under some configuration. Full batches are handed over through a
+ * small per-worker pool, which bounds memory and throttles the reader.
+ *
+ * Workers run on private copies of the cache_t structs, which share the
+ * set arrays but keep their own counters and clocks. Clocks are only
+ * compared within a set and each set has a single owner, so the results
+ * are identical to a serial run.
+ */
+
+#define MAX_WORKERS 64
+#define BATCH_LEN 4096
+#define BATCHES_PER_WORKER 8
+
+typedef struct
+{
+  unsigned long long addr;
+  int is_store;
+} access_t;
+
+typedef struct
+{
+  int n;
+  access_t acc[BATCH_LEN];
+} batch_t;
+
+/* Blocking FIFO of batch pointers with a fixed capacity. */
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  batch_t *items[BATCHES_PER_WORKER + 1];
+  int head, count;
+} batch_queue_t;
+
+typedef struct
+{
+  int id, n_workers;
+  cache_t *caches; /* private copies */
+  int n_caches;
+  batch_queue_t full, empty;
+  batch_t *filling; /* owned by the reader */
+  pthread_t thread;
+} worker_t;
+
+static void batch_queue_init(batch_queue_t *q)
+{
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->cond, NULL);
+  q->head = q->count = 0;
+}
+
+static void batch_queue_destroy(batch_queue_t *q)
+{
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->cond);
+}
+
+static void batch_queue_push(batch_queue_t *q, batch_t *batch)
+{
+  pthread_mutex_lock(&q->lock);
+  q->items[(q->head + q->count) % (BATCHES_PER_WORKER + 1)] = batch;
+  ++q->count;
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static batch_t *batch_queue_pop(batch_queue_t *q)
+{
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0)
+    pthread_cond_wait(&q->cond, &q->lock);
+  batch_t *batch = q->items[q->head];
+  q->head = (q->head + 1) % (BATCHES_PER_WORKER + 1);
+  --q->count;
+  pthread_mutex_unlock(&q->lock);
+  return batch;
+}
+
+/* Worker owning the set of addr under c. */
+static inline int shard_of(const cache_t *c, unsigned long long addr, int n_workers)
+{
+  unsigned long long set_idx = (addr >> c->b) & ((1ULL << c->s) - 1);
+  return (int)(((unsigned __int128)set_idx * (unsigned)n_workers) >> c->s);
+}
+
+static void *worker_main(void *arg)
+{
+  worker_t *w = (worker_t *)arg;
+  for (;;)
+  {
+    batch_t *batch = batch_queue_pop(&w->full);
+    if (batch->n == 0)
+    {
+      batch_queue_push(&w->empty, batch);
+      return NULL;
+    }
+    for (int i = 0; i < w->n_caches; ++i)
+    {
+      cache_t *c = &w->caches[i];
+      for (int k = 0; k < batch->n; ++k)
+        if (w->n_caches == 1 || shard_of(c, batch->acc[k].addr, w->n_workers) == w->id)
+          cache_access(c, batch->acc[k].addr, batch->acc[k].is_store);
+    }
+    batch->n = 0;
+    batch_queue_push(&w->empty, batch);
+  }
+}
+
+static inline void dispatch_access(worker_t *workers, int n_workers, const cache_t *caches, int n_caches,
+                                   unsigned long long addr, int is_store)
+{
+  unsigned long long targets = 0;
+  for (int i = 0; i < n_caches; ++i)
+    targets |= 1ULL << shard_of(&caches[i], addr, n_workers);
+  while (targets)
+  {
+    worker_t *w = &workers[__builtin_ctzll(targets)];
+    targets &= targets - 1;
+    batch_t *batch = w->filling;
+    batch->acc[batch->n].addr = addr;
+    batch->acc[batch->n].is_store = is_store;
+    if (++batch->n == BATCH_LEN)
+    {
+      batch_queue_push(&w->full, batch);
+      w->filling = batch_queue_pop(&w->empty);
+    }
+  }
+}
+
+/*
+ * Simulates the whole trace on n_workers threads. Returns 0, -1 if out of
+ * memory, or -2 if a thread could not be started.
+ */
+static int run_sharded(trace_t *trace, cache_t *caches, int n_caches, mrc_t *mrc, int n_workers)
+{
+  worker_t *workers = (worker_t *)calloc(n_workers, sizeof(worker_t));
+  batch_t *pool = (batch_t *)malloc(sizeof(batch_t) * BATCHES_PER_WORKER * n_workers);
+  cache_t *copies = (cache_t *)malloc(sizeof(cache_t) * n_caches * n_workers);
+  if (!workers || !pool || !copies)
+  {
+    free(workers);
+    free(pool);
+    free(copies);
+    return -1;
+  }
+  for (int id = 0; id < n_workers; ++id)
+  {
+    worker_t *w = &workers[id];
+    w->id = id;
+    w->n_workers = n_workers;
+    w->caches = &copies[id * n_caches];
+    w->n_caches = n_caches;
+    for (int i = 0; i < n_caches; ++i)
+    {
+      w->caches[i] = caches[i];
+      w->caches[i].hits = w->caches[i].misses = w->caches[i].evictions = 0;
+      w->caches[i].dirty_evictions = 0;
+    }
+    batch_queue_init(&w->full);
+    batch_queue_init(&w->empty);
+    for (int k = 1; k < BATCHES_PER_WORKER; ++k)
+    {
+      pool[id * BATCHES_PER_WORKER + k].n = 0;
+      batch_queue_push(&w->empty, &pool[id * BATCHES_PER_WORKER + k]);
+    }
+    w->filling = &pool[id * BATCHES_PER_WORKER];
+    w->filling->n = 0;
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0)
+    {
+      /* stop the workers already running with their empty batches */
+      for (int k = 0; k < id; ++k)
+        batch_queue_push(&workers[k].full, workers[k].filling);
+      for (int k = 0; k < id; ++k)
+        pthread_join(workers[k].thread, NULL);
+      for (int k = 0; k <= id; ++k)
+      {
+        batch_queue_destroy(&workers[k].full);
+        batch_queue_destroy(&workers[k].empty);
+      }
+      free(workers);
+      free(pool);
+      free(copies);
+      return -2;
+    }
+  }
+
+  int err = 0;
+  trace_rec_t rec;
+  while (trace_next(trace, &rec))
+  {
+    char op = rec.op;
+    if (op == 0 || op == 'I')
+      continue;
+    int is_store = (op == 'S' || op == 'M');
+    int accesses = (op == 'M') ? 2 : 1;
+    progress_add(trace, (unsigned long long)accesses);
+    for (int a = 0; a < accesses; ++a)
+    {
+      if (mrc && mrc_access(mrc, rec.addr) != 0)
+        err = -1;
+      dispatch_access(workers, n_workers, caches, n_caches, rec.addr, is_store);
+    }
+  }
+
+  /* flush partial batches, then an empty batch tells each worker to stop */
+  for (int id = 0; id < n_workers; ++id)
+  {
+    worker_t *w = &workers[id];
+    if (w->filling->n)
+    {
+      batch_queue_push(&w->full, w->filling);
+      w->filling = batch_queue_pop(&w->empty);
+    }
+    batch_queue_push(&w->full, w->filling);
+  }
+  for (int id = 0; id < n_workers; ++id)
+  {
+    worker_t *w = &workers[id];
+    pthread_join(w->thread, NULL);
+    for (int i = 0; i < n_caches; ++i)
+    {
+      caches[i].hits += w->caches[i].hits;
+      caches[i].misses += w->caches[i].misses;
+      caches[i].evictions += w->caches[i].evictions;
+      caches[i].dirty_evictions += w->caches[i].dirty_evictions;
+    }
+    batch_queue_destroy(&w->full);
+    batch_queue_destroy(&w->empty);
+  }
+  free(workers);
+  free(pool);
+  free(copies);
+  return err;
+}
+
+/*
+ * Prefetchers.
+ *
+ * Each configuration can get its own prefetcher:
+ *
+ *   next    on a miss, or the first use of a prefetched line, fetch the
+ *           next degree blocks (tagged next-line prefetching)
+ *   stride  a table indexed by the register id, standing in for the PC,
+ *           learns the address stride of each register; once the same
+ *           stride was seen twice in a row, fetch degree strides ahead
+ *   stream  Jouppi stream buffers: a miss allocates the least recently
+ *           used buffer and fills it with the next depth blocks. A miss
+ *           that matches the head of a buffer is served from it instead
+ *           of memory, and the buffer fetches one more block at its tail
+ *
+ * Next-line and stride prefetches go straight into the cache, and a flag
+ * per line remembers that it has not been used yet. A stream buffer hit
+ * moves the block into the cache and counts as a cache hit. Prefetch hits
+ * are therefore included in the cache's hits; a prefetch is useless when
+ * its line is evicted, or its stream buffer entry discarded, before use,
+ * or still unused at the end.
+ */
+
+#define PF_STRIDE_ENTRIES 64
+
+enum
+{
+  PF_NEXT,
+  PF_STRIDE,
+  PF_STREAM,
+  PF_COUNT
+};
+
+static const char *const prefetch_names[] = {"next", "stride", "stream"};
+
+typedef struct
+{
+  unsigned long long last_addr;
+  long long stride;
+  int confidence;
+} pf_stride_t;
+
+/* Consecutive blocks head .. head + count - 1 are in flight or ready. */
+typedef struct
+{
+  unsigned long long head, last_use;
+  int count;
+} pf_stream_t;
+
+typedef struct
+{
+  int kind, degree; /* degree is the stream depth for PF_STREAM */
+  int n_streams;
+  unsigned char *unused; /* per line: filled by a prefetch and not yet used */
+  pf_stride_t stride[PF_STRIDE_ENTRIES];
+  pf_stream_t *streams;
+  unsigned long long clock;
+  unsigned long long issued, hits, useless;
+} prefetcher_t;
+
+typedef struct
+{
+  int kind, degree, n_streams;
+} prefetch_spec_t;
+
+/* Parses "next[,degree]", "stride[,degree]" or "stream[,buffers[,depth]]". Returns 0 on success. */
+static int parse_prefetch(const char *arg, prefetch_spec_t *spec)
+{
+  char name[8];
+  int a = -1, b = -1;
+  char extra;
+  int k = sscanf(arg, "%7[a-z],%d,%d%c", name, &a, &b, &extra);
+  spec->kind = -1;
+  for (int i = 0; i < PF_COUNT; ++i)
+    if (k >= 1 && strcmp(name, prefetch_names[i]) == 0)
+      spec->kind = i;
+  if (spec->kind < 0 || k > 3 || (k == 3 && spec->kind != PF_STREAM))
+    return -1;
+  if (spec->kind == PF_STREAM)
+  {
+    spec->n_streams = k >= 2 ? a : 4;
+    spec->degree = k >= 3 ? b : 4;
+  }
+  else
+    spec->degree = k >= 2 ? a : 1;
+  return spec->degree > 0 && (spec->kind != PF_STREAM || spec->n_streams > 0) ? 0 : -1;
+}
+
+static int prefetcher_init(prefetcher_t *p, const prefetch_spec_t *spec, const cache_t *c)
+{
+  memset(p, 0, sizeof(*p));
+  p->kind = spec->kind;
+  p->degree = spec->degree;
+  p->n_streams = spec->n_streams;
+  p->unused = (unsigned char *)calloc((size_t)c->stride << c->s, 1);
+  if (p->kind == PF_STREAM)
+    p->streams = (pf_stream_t *)calloc(p->n_streams, sizeof(pf_stream_t));
+  return p->unused && (p->kind != PF_STREAM || p->streams) ? 0 : -1;
+}
+
+static void prefetcher_free(prefetcher_t *p)
+{
+  free(p->unused);
+  free(p->streams);
+}
+
+/* Installs the block of addr unless it is cached already, marking it unused. */
+static void prefetch_fill(prefetcher_t *p, cache_t *c, unsigned long long addr)
+{
+  if (cache_contains(c, addr))
+    return;
+  unsigned long long victim;
+  int victim_dirty;
+  if (cache_insert(c, addr, 0, &victim, &victim_dirty))
+    p->useless += p->unused[c->last_slot];
+  p->unused[c->last_slot] = 1;
+  ++p->issued;
+}
+
+/* Serves a miss from a stream buffer if one holds the block at its head, else reallocates one. */
+static void prefetch_stream(prefetcher_t *p, cache_t *c, unsigned long long addr)
+{
+  unsigned long long block = addr >> c->b;
+  pf_stream_t *lru = &p->streams[0];
+  ++p->clock;
+  for (int i = 0; i < p->n_streams; ++i)
+  {
+    pf_stream_t *st = &p->streams[i];
+    if (st->count && st->head == block)
+    {
+      unsigned long long victim;
+      int victim_dirty;
+      if (cache_insert(c, addr, 0, &victim, &victim_dirty))
+        p->useless += p->unused[c->last_slot];
+      p->unused[c->last_slot] = 0;
+      ++p->hits;
+      ++st->head;
+      ++p->issued; /* the tail fetches the next block */
+      st->last_use = p->clock;
+      return;
+    }
+    if (st->last_use < lru->last_use)
+      lru = st;
+  }
+  p->useless += (unsigned long long)lru->count;
+  lru->head = block + 1;
+  lru->count = p->degree;
+  lru->last_use = p->clock;
+  p->issued += (unsigned long long)p->degree;
+}
+
+/* Simulates a demand access with prefetching; returns what cache_access() would. */
+static inline int prefetch_access(prefetcher_t *p, cache_t *c, unsigned long long addr, int is_store, int reg)
+{
+  if (p->kind == PF_STREAM && !cache_contains(c, addr))
+    prefetch_stream(p, c, addr);
+  int result = cache_access(c, addr, is_store);
+  unsigned char *unused = &p->unused[c->last_slot];
+  int first_use = result == ACCESS_HIT && *unused;
+  if (first_use)
+    ++p->hits;
+  else if (result & ACCESS_EVICT)
+    p->useless += *unused;
+  *unused = 0;
+
+  unsigned long long block_bytes = 1ULL << c->b;
+  if (p->kind == PF_NEXT && (result != ACCESS_HIT || first_use))
+  {
+    unsigned long long base = addr & ~(block_bytes - 1);
+    for (int k = 1; k <= p->degree; ++k)
+      prefetch_fill(p, c, base + (unsigned long long)k * block_bytes);
+  }
+  else if (p->kind == PF_STRIDE && reg >= 0)
+  {
+    pf_stride_t *e = &p->stride[reg % PF_STRIDE_ENTRIES];
+    long long stride = (long long)(addr - e->last_addr);
+    if (stride == e->stride && stride != 0)
+      e->confidence += e->confidence < 3;
+    else
+    {
+      e->stride = stride;
+      e->confidence = 0;
+    }
+    e->last_addr = addr;
+    if (e->confidence >= 1)
+      for (int k = 1; k <= p->degree; ++k)
+      {
+        unsigned long long target = addr + (unsigned long long)(e->stride * k);
+        if ((target ^ addr) >= block_bytes)
+          prefetch_fill(p, c, target);
+      }
+  }
+  return result;
+}
+
+/* Counts the prefetches still unused at the end of the trace as useless. */
+static void prefetcher_finish(prefetcher_t *p, const cache_t *c)
+{
+  for (unsigned long long set = 0; set < (1ULL << c->s); ++set)
+  {
+    const unsigned long long *valid = &c->valid[set * c->words];
+    for (int way = 0; way < c->E; ++way)
+      p->useless += ((valid[way / 64] >> (way % 64)) & 1) & p->unused[set * c->stride + way];
+  }
+  for (int i = 0; i < p->n_streams; ++i)
+    p->useless += (unsigned long long)p->streams[i].count;
+}
+
+static void printPrefetch(const cache_t *caches, const prefetcher_t *prefetch, int n_caches)
+{
+  for (int i = 0; i < n_caches; ++i)
+    printf("s:%d E:%d b:%d prefetch:%s prefetches:%llu prefetch_hits:%llu useless_prefetches:%llu\n", caches[i].s,
+           caches[i].E, caches[i].b, prefetch_names[prefetch[i].kind], prefetch[i].issued, prefetch[i].hits,
+           prefetch[i].useless);
+}
+
+/*
+ * Victim and miss caches.
+ *
+ * Small fully associative LRU buffers beside each configuration, modelled as
+ * caches with s = 0 and the same block size. A victim cache keeps the lines
+ * the main cache evicts; a miss cache (Jouppi) keeps the lines it missed on.
+ * A main cache miss that finds its block in the buffer is absorbed: the line
+ * comes back from the buffer rather than memory. The main cache holds the
+ * same lines either way, so its own counts are unchanged and absorbed misses
+ * are reported separately.
+ */
+
+enum
+{
+  SIDE_VICTIM,
+  SIDE_MISS
+};
+
+static const char *const side_names[] = {"victim_cache", "miss_cache"};
+
+typedef struct
+{
+  int kind;
+  cache_t buf;
+  unsigned long long absorbed;
+} side_cache_t;
+
+static int side_init(side_cache_t *v, int kind, int entries, const cache_t *c)
+{
+  memset(v, 0, sizeof(*v));
+  v->kind = kind;
+  return cache_init(&v->buf, 0, entries, c->b, POLICY_LRU, 1);
+}
+
+static void side_free(side_cache_t *v)
+{
+  if (v->buf.tags)
+    cache_free(&v->buf);
+}
+
+/* Follows one access of the main cache c that ended in result. */
+static inline void side_access(side_cache_t *v, const cache_t *c, unsigned long long addr, int result)
+{
+  if (result == ACCESS_HIT)
+    return;
+  unsigned long long victim;
+  int dirty;
+  if (v->kind == SIDE_VICTIM)
+  {
+    /* a hit swaps the line with the main cache's victim */
+    v->absorbed += (unsigned long long)cache_invalidate(&v->buf, addr, &dirty);
+    if (result & ACCESS_EVICT)
+      cache_insert(&v->buf, c->last_victim, c->last_victim_dirty, &victim, &dirty);
+  }
+  else if (cache_probe(&v->buf, addr, 0))
+    ++v->absorbed;
+  else
+    cache_insert(&v->buf, addr, 0, &victim, &dirty);
+}
+
+static void printSideCaches(const cache_t *caches, const side_cache_t *side, int n_sides, int n_caches)
+{
+  for (int k = 0; k < n_sides; ++k)
+    for (int i = 0; i < n_caches; ++i)
+    {
+      const side_cache_t *v = &side[k * n_caches + i];
+      printf("s:%d E:%d b:%d %s:%d absorbed:%llu remaining_misses:%llu\n", caches[i].s, caches[i].E, caches[i].b,
+             side_names[v->kind], v->buf.E, v->absorbed, caches[i].misses - v->absorbed);
+    }
+}
+
+/*
+ * Miss attribution.
+ *
+ * printTrace lays out A (m x n), B (n x p), C (m x p) and the buffer
+ * contiguously as 4-byte ints starting at 0x30000000. Given those sizes, the
+ * first configuration's hits, misses and evictions are split by the region
+ * and the register id of the access that caused them. Victims are charged to
+ * the region they came from, which shows whose lines were thrown out and
+ * which of them had to be written back.
+ */
+
+#define ATTRIB_BASE 0x30000000ULL
+#define ATTRIB_REGS 64 /* register ids outside [0, ATTRIB_REGS) share the last row */
+
+enum
+{
+  REGION_A,
+  REGION_B,
+  REGION_C,
+  REGION_BUFFER,
+  REGION_OTHER,
+  N_REGIONS
+};
+
+static const char *const region_names[] = {"A", "B", "C", "buffer", "other"};
+
+typedef struct
+{
+  unsigned long long hits, misses, evictions;
+  unsigned long long evicted, writebacks; /* lines of this region thrown out */
+} attrib_count_t;
+
+typedef struct
+{
+  unsigned long long end[REGION_OTHER]; /* one past the last byte of each region */
+  attrib_count_t region[N_REGIONS];
+  attrib_count_t reg[ATTRIB_REGS + 1];
+} attrib_t;
+
+/* Parses "m,n,p[,buffer]" (buffer in ints, default BUFFER_SIZE = 64). Returns 0 on success. */
+static int attrib_init(attrib_t *a, const char *arg)
+{
+  long long dim[4] = {0, 0, 0, 64};
+  char extra;
+  int k = sscanf(arg, "%lld,%lld,%lld,%lld%c", &dim[0], &dim[1], &dim[2], &dim[3], &extra);
+  if (k < 3 || k > 4 || dim[0] <= 0 || dim[1] <= 0 || dim[2] <= 0 || dim[3] < 0)
+    return -1;
+  memset(a, 0, sizeof(*a));
+  long long ints[REGION_OTHER] = {dim[0] * dim[1], dim[1] * dim[2], dim[0] * dim[2], dim[3]};
+  unsigned long long end = ATTRIB_BASE;
+  for (int r = 0; r < REGION_OTHER; ++r)
+    a->end[r] = end += 4ULL * (unsigned long long)ints[r];
+  return 0;
+}
+
+static inline int region_of(const attrib_t *a, unsigned long long addr)
+{
+  if (addr < ATTRIB_BASE)
+    return REGION_OTHER;
+  int r = 0;
+  while (r < REGION_OTHER && addr >= a->end[r])
+    ++r;
+  return r;
+}
+
+static inline void attrib_record(attrib_t *a, const cache_t *c, unsigned long long addr, int reg, int result)
+{
+  attrib_count_t *rows[2] = {&a->region[region_of(a, addr)],
+                             &a->reg[reg >= 0 && reg < ATTRIB_REGS ? reg : ATTRIB_REGS]};
+  for (int k = 0; k < 2; ++k)
+  {
+    if (result == ACCESS_HIT)
+      ++rows[k]->hits;
+    else
+      ++rows[k]->misses;
+    if (result & ACCESS_EVICT)
+      ++rows[k]->evictions;
+  }
+  if (result & ACCESS_EVICT)
+  {
+    attrib_count_t *victim = &a->region[region_of(a, c->last_victim)];
+    ++victim->evicted;
+    victim->writebacks += (unsigned long long)c->last_victim_dirty;
+  }
+}
+
+static void printAttribution(const attrib_t *a)
+{
+  unsigned long long start = ATTRIB_BASE;
+  for (int r = 0; r < N_REGIONS; ++r)
+  {
+    const attrib_count_t *n = &a->region[r];
+    if (r == REGION_OTHER)
+    {
+      if (n->hits + n->misses + n->evicted == 0)
+        continue;
+      printf("region %-6s", region_names[r]);
+    }
+    else
+    {
+      printf("region %-6s [0x%llx, 0x%llx)", region_names[r], start, a->end[r]);
+      start = a->end[r];
+    }
+    printf(" hits:%llu misses:%llu evictions:%llu evicted:%llu writebacks:%llu\n", n->hits, n->misses,
+           n->evictions, n->evicted, n->writebacks);
+  }
+  for (int reg = 0; reg <= ATTRIB_REGS; ++reg)
+  {
+    const attrib_count_t *n = &a->reg[reg];
+    if (n->hits + n->misses == 0)
+      continue;
+    if (reg == ATTRIB_REGS)
+      printf("reg other");
+    else
+      printf("reg %-5d", reg);
+    printf(" hits:%llu misses:%llu evictions:%llu\n", n->hits, n->misses, n->evictions);
+  }
+}
+
+/*
+ * 3C miss classification.
+ *
+ * Each configuration gets a shadow fully associative LRU cache with the same
+ * number of lines and block size, measured by the stack engine with s = 0:
+ * an access misses there exactly when its reuse distance is cold or at least
+ * the number of lines. A miss of the real cache is compulsory on the first
+ * touch of its block, capacity if the shadow cache misses as well, and
+ * conflict otherwise.
+ */
+
+typedef struct
+{
+  stackdist_t sd;
+  long long lines;
+  unsigned long long compulsory, capacity, conflict;
+} classify_t;
+
+static int classify_init(classify_t *k, const cache_t *c)
+{
+  memset(k, 0, sizeof(*k));
+  k->lines = (long long)c->E << c->s;
+  return stackdist_init(&k->sd, 0, c->b);
+}
+
+static void classify_free(classify_t *k)
+{
+  stackdist_free(&k->sd);
+}
+
+static inline int classify_access(classify_t *k, unsigned long long addr, int result)
+{
+  long long d = stackdist_access(&k->sd, addr);
+  if (d == -2)
+    return -1;
+  if (result == ACCESS_HIT)
+    return 0;
+  if (d == SD_COLD)
+    ++k->compulsory;
+  else if (d >= k->lines)
+    ++k->capacity;
+  else
+    ++k->conflict;
+  return 0;
+}
+
+static void printClassification(const cache_t *caches, const classify_t *classify, int n_caches)
+{
+  for (int i = 0; i < n_caches; ++i)
+    printf("s:%d E:%d b:%d compulsory:%llu capacity:%llu conflict:%llu\n", caches[i].s, caches[i].E, caches[i].b,
+           classify[i].compulsory, classify[i].capacity, classify[i].conflict);
+}
+
+/*
+ * Reuse distance histogram.
+ *
+ * The reuse distance of an access is the number of distinct other blocks
+ * touched since the previous access to its block, measured by the stack
+ * engine with s = 0 in O(log n) per access. A fully associative LRU cache
+ * of N lines hits exactly the accesses at a distance below N, so the
+ * cumulative column reads as the hit ratio of a cache of that many lines.
+ * Distances are bucketed by powers of two: 0, 1, 2-3, 4-7 and so on. With
+ * -a, the accesses are also split by the region they fall in; the distance
+ * still counts the blocks of every region.
+ */
+
+#define REUSE_BUCKETS 64 /* bucket 0 holds distance 0, bucket k > 0 holds [2^(k-1), 2^k) */
+
+typedef struct
+{
+  stackdist_t sd;
+  const attrib_t *regions; /* NULL without -a */
+  /* one row per region, then all accesses; the last bucket counts first touches */
+  unsigned long long hist[N_REGIONS + 1][REUSE_BUCKETS + 1];
+} reuse_t;
+
+static int reuse_init(reuse_t *u, int b, const attrib_t *regions)
+{
+  memset(u, 0, sizeof(*u));
+  u->regions = regions;
+  return stackdist_init(&u->sd, 0, b);
+}
+
+static void reuse_free(reuse_t *u)
+{
+  stackdist_free(&u->sd);
+}
+
+static inline int reuse_access(reuse_t *u, unsigned long long addr)
+{
+  long long d = stackdist_access(&u->sd, addr);
+  if (d == -2)
+    return -1;
+  int bucket = d == SD_COLD ? REUSE_BUCKETS : d == 0 ? 0 : 64 - __builtin_clzll((unsigned long long)d);
+  ++u->hist[N_REGIONS][bucket];
+  if (u->regions)
+    ++u->hist[region_of(u->regions, addr)][bucket];
+  return 0;
+}
+
+static void printReuseDistance(const reuse_t *u)
+{
+  const unsigned long long *all = u->hist[N_REGIONS];
+  int shown[N_REGIONS], n_shown = 0;
+  for (int r = 0; u->regions && r < N_REGIONS; ++r)
+  {
+    unsigned long long n = 0;
+    for (int k = 0; k <= REUSE_BUCKETS; ++k)
+      n += u->hist[r][k];
+    if (r != REGION_OTHER || n)
+      shown[n_shown++] = r;
+  }
+  unsigned long long accesses = 0;
+  int top = 0;
+  for (int k = 0; k <= REUSE_BUCKETS; ++k)
+  {
+    accesses += all[k];
+    if (all[k] && k < REUSE_BUCKETS)
+      top = k;
+  }
+
+  printf("reuse distance (b=%d):\n", u->sd.b);
+  printf("%-12s %14s %10s", "distance", "all", "cumulative");
+  for (int i = 0; i < n_shown; ++i)
+    printf(" %14s", region_names[shown[i]]);
+  printf("\n");
+  unsigned long long below = 0;
+  for (int k = 0; k <= top + 1; ++k)
+  {
+    char label[48];
+    int bucket = k > top ? REUSE_BUCKETS : k;
+    if (bucket == REUSE_BUCKETS)
+      snprintf(label, sizeof(label), "cold");
+    else if (bucket <= 1)
+      snprintf(label, sizeof(label), "%d", bucket);
+    else
+      snprintf(label, sizeof(label), "%llu-%llu", 1ULL << (bucket - 1), (1ULL << bucket) - 1);
+    below += all[bucket];
+    printf("%-12s %14llu %10.6f", label, all[bucket], accesses ? (double)below / (double)accesses : 0.0);
+    for (int i = 0; i < n_shown; ++i)
+      printf(" %14llu", u->hist[shown[i]][bucket]);
+    printf("\n");
+  }
+}
+
+/*
+ * Buffered per-access output.
+ *
+ * A printf per access costs far more than simulating it, so verbose lines
+ * and binary events are formatted by hand into a large buffer that goes out
+ * with one fwrite when full. Writers reserve room for a whole line or record
+ * up front and then append without further checks.
+ *
+ * The binary event log (-e) starts with "\x89CLE", a version byte and three
+ * zero bytes, followed by one 24 byte little-endian record per access and
+ * configuration:
+ *
+ *   0  u64  address
+ *   8  u64  tag of the evicted line, 0 unless evicted
+ *   16 u8   result: 0 hit, 1 miss, 3 miss with eviction
+ *   17 u8   op character (L, S or M)
+ *   18      2 zero bytes
+ *   20 u32  configuration index
+ *
+ * Version 1 had the index in a single byte at offset 17 and the op at 18.
+ */
+
+#define OUT_BUF_LEN (1 << 20)
+#define EVENT_VERSION 2
+#define EVENT_REC_LEN 24
+
+typedef struct
+{
+  FILE *fp;
+  size_t len;
+  int err;
+  char buf[OUT_BUF_LEN];
+} outbuf_t;
+
+static outbuf_t verbose_out;
+
+static void out_flush(outbuf_t *o)
+{
+  if (o->len && fwrite(o->buf, 1, o->len, o->fp) != o->len)
+    o->err = 1;
+  o->len = 0;
+}
+
+static inline void out_reserve(outbuf_t *o, size_t n)
+{
+  if (o->len + n > OUT_BUF_LEN)
+    out_flush(o);
+}
+
+static inline void out_char(outbuf_t *o, char ch)
+{
+  o->buf[o->len++] = ch;
+}
+
+static inline void out_str(outbuf_t *o, const char *str)
+{
+  while (*str)
+    o->buf[o->len++] = *str++;
+}
+
+static inline void out_dec(outbuf_t *o, long long v)
+{
+  char digits[20];
+  int n = 0;
+  unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+  if (v < 0)
+    out_char(o, '-');
+  do
+  {
+    digits[n++] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u);
+  while (n)
+    o->buf[o->len++] = digits[--n];
+}
+
+static inline void out_hex(outbuf_t *o, unsigned long long v)
+{
+  char digits[16];
+  int n = 0;
+  do
+  {
+    digits[n++] = "0123456789abcdef"[v & 15];
+    v >>= 4;
+  } while (v);
+  while (n)
+    o->buf[o->len++] = digits[--n];
+}
+
+static inline void out_u64le(outbuf_t *o, unsigned long long v)
+{
+  for (int k = 0; k < 8; ++k, v >>= 8)
+    o->buf[o->len++] = (char)(v & 0xff);
+}
+
+static inline void out_u32le(outbuf_t *o, unsigned v)
+{
+  for (int k = 0; k < 4; ++k, v >>= 8)
+    o->buf[o->len++] = (char)(v & 0xff);
+}
+
+static int events_open(outbuf_t *o, const char *path)
+{
+  static const char header[8] = {(char)0x89, 'C', 'L', 'E', EVENT_VERSION, 0, 0, 0};
+  o->len = 0;
+  o->err = 0;
+  if (!(o->fp = fopen(path, "wb")))
+    return -1;
+  memcpy(o->buf, header, sizeof(header));
+  o->len = sizeof(header);
+  return 0;
+}
+
+/* Flushes and closes the log. Returns 0, or -1 if any write failed. */
+static int events_close(outbuf_t *o)
+{
+  out_flush(o);
+  if (fclose(o->fp) != 0)
+    o->err = 1;
+  return o->err ? -1 : 0;
+}
+
+static inline void event_record(outbuf_t *o, const cache_t *c, int index, char op, unsigned long long addr,
+                                int result)
+{
+  out_reserve(o, EVENT_REC_LEN);
+  out_u64le(o, addr);
+  out_u64le(o, (result & ACCESS_EVICT) ? c->last_victim >> (c->s + c->b) : 0);
+  out_char(o, (char)result);
+  out_char(o, op);
+  out_char(o, 0);
+  out_char(o, 0);
+  out_u32le(o, (unsigned)index);
+}
+
+/* One "op addr,size" verbose prefix; the caller appends the outcome. */
+static inline void verbose_access(outbuf_t *o, char op, unsigned long long addr, int size)
+{
+  out_reserve(o, 128);
+  out_char(o, op);
+  out_char(o, ' ');
+  out_hex(o, addr);
+  out_char(o, ',');
+  out_dec(o, size);
+  out_char(o, ' ');
+}
+
+/*
+ * Windowed time series.
+ *
+ * Every N accesses, each configuration's hits, misses and evictions since
+ * the previous window are written as a CSV row. The working set estimate is
+ * the number of distinct blocks touched within the window; it is counted in
+ * a hash set whose slots carry the window number, so starting a new window
+ * clears it for free.
+ */
+
+typedef struct
+{
+  unsigned long long *keys; /* block number */
+  unsigned long long *stamp; /* window that inserted the key, 0 for never */
+  unsigned long long cap, n;
+} ws_set_t;
+
+typedef struct
+{
+  unsigned long long len, count, index;
+  int working_set;
+  FILE *fp;
+  unsigned long long *last; /* hits, misses, evictions per configuration at the window start */
+  ws_set_t *ws;
+} window_t;
+
+static int ws_insert(ws_set_t *w, unsigned long long block, unsigned long long stamp);
+
+static int ws_grow(ws_set_t *w, unsigned long long stamp)
+{
+  ws_set_t old = *w;
+  w->cap = old.cap ? old.cap * 2 : 1024;
+  w->n = 0;
+  w->keys = (unsigned long long *)malloc(sizeof(unsigned long long) * w->cap);
+  w->stamp = (unsigned long long *)calloc(w->cap, sizeof(unsigned long long));
+  if (!w->keys || !w->stamp)
+  {
+    free(w->keys);
+    free(w->stamp);
+    *w = old;
+    return -1;
+  }
+  for (unsigned long long i = 0; i < old.cap; ++i)
+    if (old.stamp[i] == stamp)
+      ws_insert(w, old.keys[i], stamp);
+  free(old.keys);
+  free(old.stamp);
+  return 0;
+}
+
+/* Adds block to the set of window stamp. Returns 0, or -1 if out of memory. */
+static int ws_insert(ws_set_t *w, unsigned long long block, unsigned long long stamp)
+{
+  if ((w->n + 1) * 2 > w->cap && ws_grow(w, stamp) != 0)
+    return -1;
+  unsigned long long mask = w->cap - 1;
+  for (unsigned long long i = sd_hash(block) & mask;; i = (i + 1) & mask)
+  {
+    if (w->stamp[i] != stamp)
+    {
+      w->keys[i] = block;
+      w->stamp[i] = stamp;
+      ++w->n;
+      return 0;
+    }
+    if (w->keys[i] == block)
+      return 0;
+  }
+}
+
+/* Parses "num[,ws]". Returns 0, -1 if arg is invalid, -2 if path cannot be created, -3 if out of memory. */
+static int window_init(window_t *w, const char *arg, const char *path, int n_caches)
+{
+  char extra[4];
+  memset(w, 0, sizeof(*w));
+  int k = sscanf(arg, "%llu,%3s", &w->len, extra);
+  if (k < 1 || w->len == 0 || (k == 2 && strcmp(extra, "ws") != 0))
+    return -1;
+  w->working_set = k == 2;
+  if (!(w->fp = path ? fopen(path, "w") : stdout))
+    return -2;
+  w->last = (unsigned long long *)calloc(3 * (size_t)n_caches, sizeof(unsigned long long));
+  w->ws = (ws_set_t *)calloc(n_caches, sizeof(ws_set_t));
+  if (!w->last || !w->ws)
+    return -3;
+  fprintf(w->fp, "window,first_access,s,E,b,hits,misses,evictions,miss_rate%s\n",
+          w->working_set ? ",working_set" : "");
+  return 0;
+}
+
+static void window_free(window_t *w, int n_caches)
+{
+  if (w->fp && w->fp != stdout)
+    fclose(w->fp);
+  for (int i = 0; w->ws && i < n_caches; ++i)
+  {
+    free(w->ws[i].keys);
+    free(w->ws[i].stamp);
+  }
+  free(w->ws);
+  free(w->last);
+}
+
+/* Writes the rows of the current window, if it has any accesses, and starts the next one. */
+static void window_emit(window_t *w, const cache_t *caches, int n_caches)
+{
+  if (w->count == 0)
+    return;
+  for (int i = 0; i < n_caches; ++i)
+  {
+    const cache_t *c = &caches[i];
+    unsigned long long *last = &w->last[3 * i];
+    unsigned long long hits = c->hits - last[0], misses = c->misses - last[1], evictions = c->evictions - last[2];
+    fprintf(w->fp, "%llu,%llu,%d,%d,%d,%llu,%llu,%llu,%.6f", w->index, w->index * w->len, c->s, c->E, c->b, hits,
+            misses, evictions, (double)misses / (double)(hits + misses));
+    if (w->working_set)
+      fprintf(w->fp, ",%llu", w->ws[i].n);
+    fprintf(w->fp, "\n");
+    last[0] = c->hits;
+    last[1] = c->misses;
+    last[2] = c->evictions;
+    w->ws[i].n = 0;
+  }
+  w->count = 0;
+  ++w->index;
+}
+
+/* Counts one access; the caches must already have simulated it. Returns 0, or -1 if out of memory. */
+static inline int window_access(window_t *w, const cache_t *caches, int n_caches, unsigned long long addr)
+{
+  if (w->working_set)
+    for (int i = 0; i < n_caches; ++i)
+      if (ws_insert(&w->ws[i], addr >> caches[i].b, w->index + 1) != 0)
+        return -1;
+  if (++w->count == w->len)
+  {
+    if (w->fp == stdout)
+      out_flush(&verbose_out);
+    window_emit(w, caches, n_caches);
+  }
+  return 0;
+}
+
+/* Optional per-access models and analyses; unused ones are NULL. */
+typedef struct
+{
+  prefetcher_t *prefetch; /* one per configuration */
+  mrc_t *mrc;
+  attrib_t *attrib;     /* first configuration only */
+  classify_t *classify; /* one per configuration */
+  outbuf_t *events;
+  window_t *window;
+  side_cache_t *side; /* n_sides per configuration, victim cache first */
+  int n_sides;
+  reuse_t *reuse;
+} analysis_t;
+
+static void analysis_free(analysis_t *an, int n_caches)
+{
+  if (an->side)
+  {
+    for (int i = 0; i < an->n_sides * n_caches; ++i)
+      side_free(&an->side[i]);
+    free(an->side);
+  }
+  if (an->prefetch)
+  {
+    for (int i = 0; i < n_caches; ++i)
+      prefetcher_free(&an->prefetch[i]);
+    free(an->prefetch);
+  }
+  if (an->window)
+    window_free(an->window, n_caches);
+  if (an->mrc)
+    mrc_free(an->mrc);
+  if (an->reuse)
+    reuse_free(an->reuse);
+  if (an->classify)
+  {
+    for (int i = 0; i < n_caches; ++i)
+      classify_free(&an->classify[i]);
+    free(an->classify);
+  }
+}
+
+/* Feeds one decoded record (both halves of an M) to every cache and the analyses in an. */
+static inline int simulate_record(cache_t *caches, int n_caches, const analysis_t *an, int verbose, char op,
+                                  unsigned long long addr, int size, int reg)
+{
+  static const char *const result_names[] = {"hit", "miss", "", "miss"};
+  int is_store = (op == 'S' || op == 'M');
+  int accesses = (op == 'M') ? 2 : 1;
+  for (int a = 0; a < accesses; ++a)
+  {
+    if (an->mrc && mrc_access(an->mrc, addr) != 0)
+      return -1;
+    if (an->reuse && reuse_access(an->reuse, addr) != 0)
+      return -1;
+    for (int i = 0; i < n_caches; ++i)
+    {
+      int result = an->prefetch ? prefetch_access(&an->prefetch[i], &caches[i], addr, is_store, reg)
+                                : cache_access(&caches[i], addr, is_store);
+      for (int k = 0; k < an->n_sides; ++k)
+        side_access(&an->side[k * n_caches + i], &caches[i], addr, result);
+      if (an->attrib && i == 0)
+        attrib_record(an->attrib, &caches[0], addr, reg, result);
+      if (an->classify && classify_access(&an->classify[i], addr, result) != 0)
+        return -1;
+      if (an->events)
+        event_record(an->events, &caches[i], i, op, addr, result);
+      if (verbose)
+      {
+        outbuf_t *o = &verbose_out;
+        out_reserve(o, 128);
+        if (n_caches > 1)
+        {
+          out_char(o, '[');
+          out_dec(o, caches[i].s);
+          out_char(o, ',');
+          out_dec(o, caches[i].E);
+          out_char(o, ',');
+          out_dec(o, caches[i].b);
+          out_str(o, "] ");
+        }
+        verbose_access(o, op, addr, size);
+        out_str(o, result_names[result]);
+        out_char(o, '\n');
+      }
+    }
+    if (an->window && window_access(an->window, caches, n_caches, addr) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*
+ * Checkpoints.
+ *
+ * -C saves everything a serial run carries from one record to the next:
+ * the lines, replacement state, random streams and counters of every
+ * configuration, and the trace position with the binary delta state. -R
+ * loads it, seeks the trace and carries on, so a run split at any record
+ * ends with exactly the counts of an unsplit one, and several runs can
+ * branch from the same warmed-up checkpoint. The file is written in host
+ * byte order and is only meant to be read back by the same build.
+ *
+ * To catch a resume on another trace, the file also keeps the trace size
+ * (unknown for streams) and a hash of its bytes before the checkpoint, up
+ * to the first TRACE_HEAD_LEN of them; -R refuses a trace that differs in
+ * either.
+ */
+
+#define CKPT_VERSION 2
+#define CKPT_ORDER 0x0102030405060708ULL
+
+static const char ckpt_magic[4] = {'\x89', 'C', 'L', 'K'};
+
+/* 1 once the -C record budget runs out, 2 after SIGINT or SIGTERM while a checkpoint is pending */
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int sig)
+{
+  (void)sig;
+  stop_requested = 2;
+}
+
+typedef struct
+{
+  const char *path;
+  unsigned long long records; /* stop after this many records, 0 to run to the end */
+  int stopped;                /* the run ended before the trace did */
+} checkpoint_t;
+
+/* Parses "file[:records]". Returns 0 or -1. */
+static int checkpoint_parse(checkpoint_t *k, char *arg)
+{
+  memset(k, 0, sizeof(*k));
+  k->path = arg;
+  char *colon = strrchr(arg, ':');
+  if (colon)
+  {
+    char *end;
+    k->records = strtoull(colon + 1, &end, 10);
+    if (colon[1] == '\0' || *end || k->records == 0)
+      return -1;
+    *colon = '\0';
+  }
+  return *arg ? 0 : -1;
+}
+
+static int ckpt_write(FILE *fp, const void *p, size_t len)
+{
+  return fwrite(p, 1, len, fp) == len ? 0 : -1;
+}
+
+static int ckpt_read(FILE *fp, void *p, size_t len)
+{
+  return fread(p, 1, len, fp) == len ? 0 : -1;
+}
+
+/* What a checkpoint records of its trace. */
+typedef struct
+{
+  unsigned long long size;      /* or TRACE_SIZE_UNKNOWN */
+  unsigned long long head_len;  /* bytes hashed */
+  unsigned long long head_hash; /* FNV-1a */
+} ckpt_ident_t;
+
+/* FNV-1a of the first len bytes of trace, at most TRACE_HEAD_LEN of them. Returns 0, or -1 if they were not read. */
+static int ckpt_identify(const trace_t *trace, unsigned long long len, unsigned long long *hash)
+{
+  size_t avail;
+  const char *head = trace_head(trace, &avail);
+  if (len > TRACE_HEAD_LEN)
+    len = TRACE_HEAD_LEN;
+  if (len > avail)
+    return -1;
+  unsigned long long h = 0xcbf29ce484222325ULL;
+  for (unsigned long long i = 0; i < len; ++i)
+    h = (h ^ (unsigned char)head[i]) * 0x100000001b3ULL;
+  *hash = h;
+  return 0;
+}
+
+/* Whether trace looks like the one the checkpoint id was taken on. */
+static int ckpt_matches(const trace_t *trace, const ckpt_ident_t *id)
+{
+  unsigned long long size = trace_size(trace), hash;
+  if (size != TRACE_SIZE_UNKNOWN && id->size != TRACE_SIZE_UNKNOWN && size != id->size)
+    return 0;
+  return ckpt_identify(trace, id->head_len, &hash) == 0 && hash == id->head_hash;
+}
+
+/* Per-configuration scalars, in file order. */
+#define CKPT_CACHE_FIELDS 13
+
+static void ckpt_pack(const cache_t *c, unsigned long long *f)
+{
+  unsigned long long v[CKPT_CACHE_FIELDS] = {
+      (unsigned long long)c->s,         (unsigned long long)c->E,       (unsigned long long)c->b,
+      (unsigned long long)c->policy,    (unsigned long long)c->latency, c->use_clock,
+      c->hits,                          c->misses,                      c->evictions,
+      c->dirty_evictions,               c->last_victim,                 (unsigned long long)c->last_victim_dirty,
+      c->last_slot};
+  memcpy(f, v, sizeof(v));
+}
+
+/* Writes the checkpoint to path.tmp and renames it over path. Returns 0 or -1. */
+static int checkpoint_save(const char *path, const cache_t *caches, int n_caches, int multi,
+                           const trace_t *trace)
+{
+  size_t len = strlen(path);
+  char *tmp = (char *)malloc(len + 5);
+  if (!tmp)
+    return -1;
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".tmp", 5);
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp)
+  {
+    free(tmp);
+    return -1;
+  }
+  trace_pos_t pos;
+  trace_tell(trace, &pos);
+  ckpt_ident_t id = {trace_size(trace), pos.offset < TRACE_HEAD_LEN ? pos.offset : TRACE_HEAD_LEN, 0};
+  unsigned char version[4] = {CKPT_VERSION, 0, 0, 0};
+  unsigned long long head[9] = {CKPT_ORDER,
+                                (unsigned long long)n_caches,
+                                (unsigned long long)multi,
+                                pos.offset,
+                                pos.codec.prev_addr,
+                                (unsigned long long)pos.codec.prev_reg,
+                                id.size,
+                                id.head_len,
+                                0};
+  int err = ckpt_identify(trace, id.head_len, &head[8]) != 0;
+  err = err || ckpt_write(fp, ckpt_magic, 4) || ckpt_write(fp, version, 4) || ckpt_write(fp, head, sizeof(head));
+  for (int i = 0; i < n_caches && !err; ++i)
+  {
+    const cache_t *c = &caches[i];
+    unsigned long long S = 1ULL << c->s, f[CKPT_CACHE_FIELDS];
+    ckpt_pack(c, f);
+    err = ckpt_write(fp, f, sizeof(f)) || ckpt_write(fp, c->tags, sizeof(*c->tags) * S * c->stride) ||
+          ckpt_write(fp, c->meta, sizeof(*c->meta) * S * c->stride) || ckpt_write(fp, c->dirty, S * c->stride) ||
+          ckpt_write(fp, c->valid, sizeof(*c->valid) * S * c->words) ||
+          (c->rng && ckpt_write(fp, c->rng, sizeof(*c->rng) * S));
+  }
+  err = fclose(fp) != 0 || err;
+  if (!err)
+    err = rename(tmp, path) != 0;
+  if (err)
+    remove(tmp);
+  free(tmp);
+  return err ? -1 : 0;
+}
+
+/*
+ * Rebuilds the configurations saved in path and reads where and on what
+ * trace it was taken. Returns 0, -1 if the file cannot be read or is not a
+ * checkpoint of this build, -2 if out of memory.
+ */
+static int checkpoint_load(const char *path, cache_t **caches, int *n_caches, int *multi, trace_pos_t *pos,
+                           ckpt_ident_t *id)
+{
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return -1;
+  char magic[4];
+  unsigned char version[4];
+  unsigned long long head[9];
+  if (ckpt_read(fp, magic, 4) || ckpt_read(fp, version, 4) || ckpt_read(fp, head, sizeof(head)) ||
+      memcmp(magic, ckpt_magic, 4) != 0 || version[0] != CKPT_VERSION || head[0] != CKPT_ORDER ||
+      head[1] == 0 || head[1] > 4096)
+  {
+    fclose(fp);
+    return -1;
+  }
+  *n_caches = (int)head[1];
+  *multi = (int)head[2];
+  pos->offset = head[3];
+  pos->codec.prev_addr = head[4];
+  pos->codec.prev_reg = (int)head[5];
+  id->size = head[6];
+  id->head_len = head[7];
+  id->head_hash = head[8];
+  *caches = (cache_t *)calloc(*n_caches, sizeof(cache_t));
+  int err = *caches ? 0 : -2;
+  int i;
+  for (i = 0; i < *n_caches && !err; ++i)
+  {
+    cache_t *c = &(*caches)[i];
+    unsigned long long f[CKPT_CACHE_FIELDS];
+    if (ckpt_read(fp, f, sizeof(f)) || f[0] > 40 || f[1] == 0 || f[1] > 1U << 20 || f[2] > 63 ||
+        f[3] >= POLICY_COUNT)
+    {
+      err = -1;
+      break;
+    }
+    int init = cache_init(c, (int)f[0], (int)f[1], (int)f[2], (int)f[3], 1);
+    if (init != 0)
+    {
+      err = init == -1 ? -2 : -1;
+      break;
+    }
+    c->latency = (int)f[4];
+    c->use_clock = f[5];
+    c->hits = f[6];
+    c->misses = f[7];
+    c->evictions = f[8];
+    c->dirty_evictions = f[9];
+    c->last_victim = f[10];
+    c->last_victim_dirty = (int)f[11];
+    c->last_slot = f[12];
+    unsigned long long S = 1ULL << c->s;
+    if (ckpt_read(fp, c->tags, sizeof(*c->tags) * S * c->stride) ||
+        ckpt_read(fp, c->meta, sizeof(*c->meta) * S * c->stride) || ckpt_read(fp, c->dirty, S * c->stride) ||
+        ckpt_read(fp, c->valid, sizeof(*c->valid) * S * c->words) ||
+        (c->rng && ckpt_read(fp, c->rng, sizeof(*c->rng) * S)))
+      err = -1;
+  }
+  fclose(fp);
+  if (err)
+  {
+    while (i--)
+      cache_free(&(*caches)[i]);
+    free(*caches);
+    *caches = NULL;
+  }
+  return err;
+}
+
+/*
+ * Simulates the trace on the calling thread, up to limit records when limit
+ * is not 0, and stops early once stop_requested is set. Returns 0, or -1 if
+ * out of memory.
+ */
+static int run_serial(trace_t *trace, cache_t *caches, int n_caches, const analysis_t *an, int verbose,
+                      unsigned long long limit)
+{
+  trace_rec_t rec;
+  while (!stop_requested && trace_next(trace, &rec))
+  {
+    if (rec.op == 0 || rec.op == 'I')
+      continue;
+    progress_add(trace, rec.op == 'M' ? 2 : 1);
+    if (simulate_record(caches, n_caches, an, verbose, rec.op, rec.addr, rec.size, rec.reg) != 0)
+      return -1;
+    if (limit && --limit == 0)
+      stop_requested = 1;
+  }
+  return 0;
+}
+
+/*
+ * Set sampling.
+ *
+ * With -S only a subset of the sets of each configuration is simulated; an
+ * access to any other set costs a shift, a mask, a bitmap test and a count.
+ * Sets never interact, so the sampled ones behave exactly as in a full run.
+ *
+ * Traces are rarely spread evenly over the sets, and a few hashed sets
+ * cannot stand for a handful of sets that take most of the accesses. So the
+ * accesses of every set are counted over a prefix of a mapped trace (a
+ * sixteenth of it, within the bounds below), and the sets are stratified by
+ * the log2 of that count. In every stratum the frac of its sets with the
+ * lowest hashes is simulated, at least two of them, which takes strata of
+ * one or two sets in full. A stratum's misses and evictions are its sampled
+ * ratio to accesses times its accesses (all counted exactly over the whole
+ * trace), and the 95% confidence interval adds up the variance of those
+ * ratio estimators, with the finite population correction. A prefix that
+ * is not typical of the rest only makes the strata less pure: the interval
+ * widens, but the estimate stays sound. Streams cannot be rewound and form
+ * a single stratum, with a warning when the sampled sets see a share of the
+ * accesses far from their share of sets.
+ */
+
+#define SAMPLE_STRATA 66 /* 0 for sets the prefix missed, then one per log2 of the accesses; 65 for streams */
+#define SAMPLE_STREAM 65
+#define SAMPLE_PLAN_MIN (1ULL << 16) /* records of the prefix, at least */
+#define SAMPLE_PLAN_MAX (1ULL << 20) /* and at most */
+
+enum
+{
+  SAMPLE_ACCESSES,
+  SAMPLE_MISSES,
+  SAMPLE_EVICTIONS
+};
+
+typedef struct
+{
+  double fraction;
+  unsigned long long key;     /* seed mixed for the set hashes */
+  unsigned long long *bitmap; /* simulated sets */
+  unsigned char *stratum;     /* of every set */
+  unsigned long long n_sets, n_sampled;
+  int n_strata; /* with accesses */
+  unsigned long long *per_set;    /* accesses (of every set), misses, evictions (of simulated sets) */
+  unsigned long long accesses;    /* all accesses */
+  double miss_ratio, miss_margin; /* filled by sample_estimate */
+  double evict_ratio, evict_margin;
+} sample_t;
+
+static inline int sample_has(const sample_t *p, unsigned long long set)
+{
+  return (p->bitmap[set / 64] >> (set % 64)) & 1;
+}
+
+/* splitmix64's finalizer */
+static inline unsigned long long sample_mix(unsigned long long z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static int sample_init(sample_t *p, const cache_t *c, double fraction, unsigned long long seed)
+{
+  memset(p, 0, sizeof(*p));
+  p->fraction = fraction;
+  p->key = sample_mix(seed + 0x9e3779b97f4a7c15ULL);
+  p->n_sets = 1ULL << c->s;
+  p->bitmap = (unsigned long long *)calloc((p->n_sets + 63) / 64, sizeof(unsigned long long));
+  p->stratum = (unsigned char *)malloc(p->n_sets);
+  p->per_set = (unsigned long long *)calloc(p->n_sets * 3, sizeof(unsigned long long));
+  if (!p->bitmap || !p->stratum || !p->per_set)
+    return -1;
+  memset(p->stratum, SAMPLE_STREAM, p->n_sets);
+  return 0;
+}
+
+static void sample_free(sample_t *p)
+{
+  free(p->bitmap);
+  free(p->stratum);
+  free(p->per_set);
+}
+
+static int sample_by_hash(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Picks the frac of every stratum with the lowest hashes, at least two sets. Returns 0, or -1 if out of memory. */
+static int sample_select(sample_t *p)
+{
+  unsigned long long *order = (unsigned long long *)malloc(sizeof(unsigned long long) * 2 * p->n_sets);
+  if (!order)
+    return -1;
+  unsigned long long size[SAMPLE_STRATA] = {0}, taken[SAMPLE_STRATA] = {0}, want[SAMPLE_STRATA];
+  for (unsigned long long set = 0; set < p->n_sets; ++set)
+  {
+    order[2 * set] = sample_mix(set ^ p->key);
+    order[2 * set + 1] = set;
+    ++size[p->stratum[set]];
+  }
+  qsort(order, p->n_sets, 2 * sizeof(unsigned long long), sample_by_hash);
+  for (int h = 0; h < SAMPLE_STRATA; ++h)
+  {
+    want[h] = (unsigned long long)ceil(p->fraction * (double)size[h]);
+    want[h] = want[h] < 2 ? 2 : want[h];
+    p->n_strata += h != 0 && size[h] != 0;
+  }
+  for (unsigned long long i = 0; i < p->n_sets; ++i)
+  {
+    unsigned long long set = order[2 * i + 1];
+    int h = p->stratum[set];
+    if (taken[h] == want[h])
+      continue;
+    ++taken[h];
+    p->bitmap[set / 64] |= 1ULL << (set % 64);
+    ++p->n_sampled;
+  }
+  free(order);
+  return 0;
+}
+
+/*
+ * Stratifies the sets of a mapped trace by their accesses in its prefix,
+ * rewinds it and picks the sets to simulate. Returns 0, or -1 if out of
+ * memory.
+ */
+static int sample_plan(trace_t *trace, const cache_t *caches, int n_caches, sample_t *samples)
+{
+  if (!trace->stream)
+  {
+    trace_pos_t start;
+    trace_tell(trace, &start);
+    trace_rec_t rec;
+    for (unsigned long long records = 0; records < SAMPLE_PLAN_MAX && trace_next(trace, &rec); ++records)
+    {
+      if (records >= SAMPLE_PLAN_MIN && trace_fraction(trace) >= 1.0 / 16.0)
+        break;
+      if (rec.op == 0 || rec.op == 'I')
+        continue;
+      for (int i = 0; i < n_caches; ++i)
+      {
+        sample_t *p = &samples[i];
+        unsigned long long set = (rec.addr >> caches[i].b) & (p->n_sets - 1);
+        p->per_set[set * 3 + SAMPLE_ACCESSES] += rec.op == 'M' ? 2 : 1;
+      }
+    }
+    trace_seek(trace, &start);
+    for (int i = 0; i < n_caches; ++i)
+    {
+      sample_t *p = &samples[i];
+      for (unsigned long long set = 0; set < p->n_sets; ++set)
+      {
+        unsigned long long n = p->per_set[set * 3 + SAMPLE_ACCESSES];
+        p->stratum[set] = (unsigned char)(n ? 64 - __builtin_clzll(n) : 0);
+        p->per_set[set * 3 + SAMPLE_ACCESSES] = 0;
+      }
+    }
+  }
+  for (int i = 0; i < n_caches; ++i)
+    if (sample_select(&samples[i]) != 0)
+      return -1;
+  return 0;
+}
+
+/* Simulates the sampled sets of every configuration. Returns 0. */
+static int run_sampled(trace_t *trace, cache_t *caches, int n_caches, sample_t *samples)
+{
+  trace_rec_t rec;
+  while (trace_next(trace, &rec))
+  {
+    if (rec.op == 0 || rec.op == 'I')
+      continue;
+    int is_store = (rec.op == 'S' || rec.op == 'M');
+    int accesses = (rec.op == 'M') ? 2 : 1;
+    progress_add(trace, (unsigned long long)accesses);
+    for (int i = 0; i < n_caches; ++i)
+    {
+      cache_t *c = &caches[i];
+      sample_t *p = &samples[i];
+      p->accesses += (unsigned long long)accesses;
+      unsigned long long set = (rec.addr >> c->b) & (p->n_sets - 1);
+      unsigned long long *counts = &p->per_set[set * 3];
+      counts[SAMPLE_ACCESSES] += (unsigned long long)accesses;
+      if (!sample_has(p, set))
+        continue;
+      for (int a = 0; a < accesses; ++a)
+      {
+        int result = cache_access(c, rec.addr, is_store);
+        counts[SAMPLE_MISSES] += result != ACCESS_HIT;
+        counts[SAMPLE_EVICTIONS] += (result & ACCESS_EVICT) != 0;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Two-sided 95% quantile of Student's t with df degrees of freedom. */
+static double sample_t95(double df)
+{
+  static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                 2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086};
+  if (df < 1.0)
+    return table[0];
+  if (df <= 20.0)
+    return table[(int)df - 1];
+  return df <= 30.0 ? 2.042 : df <= 60.0 ? 2.000 : 1.960;
+}
+
+/* Estimated share of column k in all accesses and the half-width of its 95% interval. */
+static void sample_ratio(const sample_t *p, int k, double *ratio, double *margin)
+{
+  double sets[SAMPLE_STRATA] = {0}, sampled[SAMPLE_STRATA] = {0};
+  double all[SAMPLE_STRATA] = {0}, total[SAMPLE_STRATA] = {0}, part[SAMPLE_STRATA] = {0};
+  for (unsigned long long set = 0; set < p->n_sets; ++set)
+  {
+    const unsigned long long *counts = &p->per_set[set * 3];
+    int h = p->stratum[set];
+    ++sets[h];
+    all[h] += (double)counts[SAMPLE_ACCESSES];
+    if (sample_has(p, set))
+    {
+      ++sampled[h];
+      total[h] += (double)counts[SAMPLE_ACCESSES];
+      part[h] += (double)counts[k];
+    }
+  }
+  double r[SAMPLE_STRATA], sum_sq[SAMPLE_STRATA] = {0};
+  for (int h = 0; h < SAMPLE_STRATA; ++h)
+    r[h] = total[h] > 0.0 ? part[h] / total[h] : 0.0;
+  for (unsigned long long set = 0; set < p->n_sets; ++set)
+  {
+    int h = p->stratum[set];
+    if (!sample_has(p, set))
+      continue;
+    double d = (double)p->per_set[set * 3 + k] - r[h] * (double)p->per_set[set * 3 + SAMPLE_ACCESSES];
+    sum_sq[h] += d * d;
+  }
+
+  double estimate = 0.0, variance = 0.0, df = 0.0;
+  for (int h = 0; h < SAMPLE_STRATA; ++h)
+  {
+    estimate += r[h] * all[h];
+    double n = sampled[h];
+    if (n == sets[h] || all[h] == 0.0)
+      continue;
+    if (total[h] == 0.0)
+    {
+      /* the sampled sets of this stratum saw none of its accesses: anything goes */
+      variance += all[h] * all[h];
+      continue;
+    }
+    /* a stratum seen in part: the ratio estimator's variance, scaled up to its accesses */
+    double scale = all[h] / total[h];
+    df += n - 1.0;
+    if (n >= 2.0)
+      variance += (1.0 - n / sets[h]) * sum_sq[h] / (n - 1.0) * n * scale * scale;
+    /* one count in its sampled sets stands for scale counts; claim no finer resolution */
+    variance += scale * scale;
+  }
+  double accesses = (double)p->accesses;
+  *ratio = accesses > 0.0 ? estimate / accesses : 0.0;
+  *margin = accesses > 0.0 ? sample_t95(df) * sqrt(variance) / accesses : 0.0;
+}
+
+/* Replaces the counters of c by estimates for the whole trace. */
+static void sample_estimate(sample_t *p, cache_t *c)
+{
+  sample_ratio(p, SAMPLE_MISSES, &p->miss_ratio, &p->miss_margin);
+  sample_ratio(p, SAMPLE_EVICTIONS, &p->evict_ratio, &p->evict_margin);
+  double accesses = (double)p->accesses;
+  c->misses = (unsigned long long)llround(p->miss_ratio * accesses);
+  c->hits = p->accesses - c->misses;
+  c->evictions = (unsigned long long)llround(p->evict_ratio * accesses);
+}
+
+static void printSample(const sample_t *p, const cache_t *c)
+{
+  double accesses = (double)p->accesses;
+  double lo = fmax(p->miss_ratio - p->miss_margin, 0.0) * accesses;
+  double hi = fmin(p->miss_ratio + p->miss_margin, 1.0) * accesses;
+  printf("s:%d E:%d b:%d sampled_sets:%llu/%llu strata:%d miss_ratio:%.6f+-%.6f misses_95ci:[%.0f, %.0f] "
+         "evictions_95ci:[%.0f, %.0f]\n",
+         c->s, c->E, c->b, p->n_sampled, p->n_sets, p->n_strata, p->miss_ratio, p->miss_margin, lo, hi,
+         fmax(p->evict_ratio - p->evict_margin, 0.0) * accesses, (p->evict_ratio + p->evict_margin) * accesses);
+
+  /* a stream was sampled blind: say so when the sampled sets are far from typical */
+  if (p->stratum[0] != SAMPLE_STREAM || p->n_sampled == p->n_sets || accesses == 0.0)
+    return;
+  double seen = 0.0;
+  for (unsigned long long set = 0; set < p->n_sets; ++set)
+    if (sample_has(p, set))
+      seen += (double)p->per_set[set * 3 + SAMPLE_ACCESSES];
+  double share = seen / accesses, expected = (double)p->n_sampled / (double)p->n_sets;
+  if (share < expected / 2.0 || share > expected * 2.0)
+    fprintf(stderr,
+            "warning: s:%d E:%d b:%d sampled sets see %.1f%% of the accesses instead of about %.1f%%; the "
+            "interval may be too narrow (sample a file rather than a stream)\n",
+            c->s, c->E, c->b, 100.0 * share, 100.0 * expected);
+}
+
+/*
+ * Pipelined simulation.
+ *
+ * A reader thread decodes the trace into batches of compact records and
+ * publishes them through a single-producer/single-consumer ring; the calling
+ * thread simulates them. The ring slots are the batches themselves, so the
+ * reader fills a slot in place and only the head and tail indices are
+ * shared. A side that finds the ring full or empty spins briefly and then
+ * yields. Each side times how long it waited, which shows the bottleneck.
+ */
+
+#define RING_SLOTS 64
+
+typedef struct
+{
+  unsigned long long addr;
+  int size, reg;
+  char op;
+} compact_rec_t;
+
+typedef struct
+{
+  int n; /* 0 marks the end of the trace */
+  compact_rec_t rec[BATCH_LEN];
+} rec_batch_t;
+
+typedef struct
+{
+  _Alignas(64) atomic_ullong head; /* next slot to consume */
+  _Alignas(64) atomic_ullong tail; /* next slot to produce */
+  rec_batch_t *slots;
+} spsc_ring_t;
+
+typedef struct
+{
+  spsc_ring_t ring;
+  trace_t *trace;
+  unsigned long long records;
+  double busy, waited;
+} pipeline_reader_t;
+
+/*
+ * Spins, then yields, until the other side's index satisfies the caller:
+ * the producer needs head + RING_SLOTS > tail (a free slot), the consumer
+ * needs tail > head (a full slot). Returns the seconds spent waiting.
+ */
+static inline int ring_ready(const atomic_ullong *other, unsigned long long mine, int producer)
+{
+  unsigned long long v = atomic_load_explicit(other, memory_order_acquire);
+  return producer ? v + RING_SLOTS > mine : v > mine;
+}
+
+static double ring_wait(const atomic_ullong *other, unsigned long long mine, int producer)
+{
+  if (ring_ready(other, mine, producer))
+    return 0.0;
+  double start = now_seconds();
+  for (int spins = 0; !ring_ready(other, mine, producer); ++spins)
+    if (spins > 64)
+      sched_yield();
+  return now_seconds() - start;
+}
+
+static void *pipeline_reader_main(void *arg)
+{
+  pipeline_reader_t *r = (pipeline_reader_t *)arg;
+  spsc_ring_t *ring = &r->ring;
+  unsigned long long tail = 0;
+  double start = now_seconds();
+  int done = 0;
+  while (!done)
+  {
+    r->waited += ring_wait(&ring->head, tail, 1);
+    rec_batch_t *batch = &ring->slots[tail % RING_SLOTS];
+    int n = 0;
+    trace_rec_t rec;
+    while (n < BATCH_LEN)
+    {
+      if (!trace_next(r->trace, &rec))
+      {
+        done = 1;
+        break;
+      }
+      if (rec.op == 0 || rec.op == 'I')
+        continue;
+      batch->rec[n].addr = rec.addr;
+      batch->rec[n].size = rec.size;
+      batch->rec[n].reg = rec.reg;
+      batch->rec[n].op = rec.op;
+      ++n;
+    }
+    batch->n = n;
+    r->records += n;
+    atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+    if (done && n)
+    {
+      /* terminating empty batch */
+      r->waited += ring_wait(&ring->head, tail, 1);
+      ring->slots[tail % RING_SLOTS].n = 0;
+      atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+    }
+  }
+  r->busy = now_seconds() - start - r->waited;
+  return NULL;
+}
+
+static void print_stage(const char *stage, const char *unit, unsigned long long n, double busy, double waited,
+                        const char *wait_reason)
+{
+  fprintf(stderr, "pipeline: %-9s %llu %s in %.3fs busy (%.2fM %s/s), waited %.3fs for %s\n", stage, n, unit,
+          busy, busy > 0 ? (double)n / busy * 1e-6 : 0.0, unit, waited, wait_reason);
+}
+
+/*
+ * Simulates the whole trace with decoding on a separate thread. Returns 0,
+ * -1 if out of memory, or -2 if the reader thread could not be started.
+ */
+static int run_pipelined(trace_t *trace, cache_t *caches, int n_caches, const analysis_t *an, int verbose)
+{
+  pipeline_reader_t reader;
+  memset(&reader, 0, sizeof(reader));
+  reader.trace = trace;
+  reader.ring.slots = (rec_batch_t *)malloc(sizeof(rec_batch_t) * RING_SLOTS);
+  if (!reader.ring.slots)
+    return -1;
+  atomic_init(&reader.ring.head, 0);
+  atomic_init(&reader.ring.tail, 0);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, pipeline_reader_main, &reader) != 0)
+  {
+    free(reader.ring.slots);
+    return -2;
+  }
+
+  int err = 0;
+  unsigned long long head = 0, accesses = 0;
+  double waited = 0.0, start = now_seconds();
+  for (;;)
+  {
+    waited += ring_wait(&reader.ring.tail, head, 0);
+    const rec_batch_t *batch = &reader.ring.slots[head % RING_SLOTS];
+    if (batch->n == 0)
+      break;
+    for (int k = 0; k < batch->n && !err; ++k)
+    {
+      const compact_rec_t *r = &batch->rec[k];
+      accesses += (r->op == 'M') ? 2 : 1;
+      progress_add(NULL, r->op == 'M' ? 2 : 1);
+      err = simulate_record(caches, n_caches, an, verbose, r->op, r->addr, r->size, r->reg);
+    }
+    atomic_store_explicit(&reader.ring.head, ++head, memory_order_release);
+  }
+  double busy = now_seconds() - start - waited;
+  pthread_join(thread, NULL);
+  free(reader.ring.slots);
+
+  print_stage("reader", "records", reader.records, reader.busy, reader.waited, "ring space");
+  print_stage("simulator", "accesses", accesses, busy, waited, "input");
+  fprintf(stderr, "pipeline: bottleneck is the %s\n", reader.busy >= busy ? "reader" : "simulator");
+  return err ? -1 : 0;
+}
+
+/* Opens a trace, reporting failures on stderr. Returns 0 on success. */
+static int open_trace(trace_t *trace, const char *trace_file)
+{
+  int trace_err = trace_open(trace, trace_file);
+  if (trace_err == -2)
+    fprintf(stderr, "Unsupported binary trace version: %s\n", trace_file);
+  else if (trace_err != 0)
+    fprintf(stderr, "Cannot open trace file: %s\n", trace_file);
+  return trace_err;
+}
+
+/*
+ * Multi-level hierarchy.
+ *
+ * An access looks up L1, L2, ... until some level hits, and pays the latency
+ * of every level it looked up, plus the memory latency if all of them
+ * missed. Stores only dirty the L1 copy. A dirty line that leaves a level is
+ * written to the next level below that holds the block, or to memory, which
+ * costs the write-back latency. How the missing levels are filled depends on
+ * the inclusion policy:
+ *
+ *   nine       every level that missed gets the block, and evictions in
+ *              one level do not affect the others
+ *   inclusive  like nine, but a block evicted from a lower level is also
+ *              dropped from the levels above it (back-invalidation)
+ *   exclusive  a block lives in one level at a time: a hit below L1 moves
+ *              the block up into L1, and each level's victim is pushed into
+ *              the level below it. All levels need the same block size.
+ */
+
+enum
+{
+  INCL_NINE,
+  INCL_INCLUSIVE,
+  INCL_EXCLUSIVE
+};
+
+static const char *const inclusion_names[] = {"nine", "inclusive", "exclusive"};
+
+typedef struct
+{
+  cache_t *levels;
+  int n_levels;
+  int inclusion;
+  int mem_latency;
+  int wb_latency; /* extra cycles per write-back to memory */
+  unsigned long long accesses, mem_accesses, back_invalidations, cycles;
+  unsigned long long mem_writebacks, mem_bytes_read, mem_bytes_written;
+  unsigned long long flush_writebacks; /* dirty data still cached at the end */
+} hierarchy_t;
+
+/* Sends a dirty block that left level l to the next level that holds it, or to memory. */
+static void hierarchy_write_back(hierarchy_t *h, int l, unsigned long long addr)
+{
+  for (int k = l + 1; k < h->n_levels; ++k)
+    if (cache_mark_dirty(&h->levels[k], addr))
+      return;
+  ++h->mem_writebacks;
+  h->mem_bytes_written += 1ULL << h->levels[l].b;
+  h->cycles += (unsigned long long)h->wb_latency;
+}
+
+/*
+ * Drops every block of the levels above l that overlaps the block of level l
+ * at addr. Returns 1 if any dropped copy was dirty, since its data then has
+ * to leave with the evicted block.
+ */
+static int hierarchy_back_invalidate(hierarchy_t *h, int l, unsigned long long addr)
+{
+  int any_dirty = 0;
+  int b = h->levels[l].b;
+  for (int u = 0; u < l; ++u)
+  {
+    cache_t *c = &h->levels[u];
+    unsigned long long step = 1ULL << c->b;
+    unsigned long long span = c->b >= b ? step : 1ULL << b;
+    for (unsigned long long off = 0; off < span; off += step)
+    {
+      int was_dirty = 0;
+      h->back_invalidations += (unsigned long long)cache_invalidate(c, addr + off, &was_dirty);
+      any_dirty |= was_dirty;
+    }
+  }
+  return any_dirty;
+}
+
+/* Simulates one access; returns the level that hit, or n_levels for memory. */
+static int hierarchy_access(hierarchy_t *h, unsigned long long addr, int is_store)
+{
+  int n = h->n_levels;
+  int hit_level = n;
+  ++h->accesses;
+  for (int l = 0; l < n; ++l)
+  {
+    h->cycles += (unsigned long long)h->levels[l].latency;
+    if (cache_probe(&h->levels[l], addr, is_store && l == 0))
+    {
+      hit_level = l;
+      break;
+    }
+  }
+  if (hit_level == n)
+  {
+    ++h->mem_accesses;
+    h->mem_bytes_read += 1ULL << h->levels[n - 1].b;
+    h->cycles += (unsigned long long)h->mem_latency;
+  }
+  if (hit_level == 0)
+    return 0;
+
+  unsigned long long victim;
+  int victim_dirty;
+  if (h->inclusion == INCL_EXCLUSIVE)
+  {
+    int dirty = is_store;
+    if (hit_level < n)
+    {
+      int was_dirty = 0;
+      cache_invalidate(&h->levels[hit_level], addr, &was_dirty);
+      dirty |= was_dirty;
+    }
+    unsigned long long block = addr;
+    for (int l = 0; l < n; ++l)
+    {
+      if (!cache_insert(&h->levels[l], block, dirty, &victim, &victim_dirty))
+        break;
+      if (l == n - 1 && victim_dirty)
+        hierarchy_write_back(h, l, victim);
+      block = victim;
+      dirty = victim_dirty;
+    }
+    return hit_level;
+  }
+
+  /* fill from the bottom up so that back-invalidation never hits the new block */
+  for (int l = hit_level - 1; l >= 0; --l)
+  {
+    if (!cache_insert(&h->levels[l], addr, is_store && l == 0, &victim, &victim_dirty))
+      continue;
+    if (h->inclusion == INCL_INCLUSIVE && l > 0)
+      victim_dirty |= hierarchy_back_invalidate(h, l, victim);
+    if (victim_dirty)
+      hierarchy_write_back(h, l, victim);
+  }
+  return hit_level;
+}
+
+/* Writes all dirty lines back, upper levels first, so that their data passes through the lower ones. */
+static void hierarchy_flush(hierarchy_t *h)
+{
+  unsigned long long before = h->mem_writebacks;
+  for (int l = 0; l < h->n_levels; ++l)
+  {
+    cache_t *c = &h->levels[l];
+    for (unsigned long long set = 0; set < (1ULL << c->s); ++set)
+    {
+      const unsigned long long *valid = &c->valid[set * c->words];
+      for (int way = 0; way < c->E; ++way)
+      {
+        unsigned long long i = set * c->stride + way;
+        if (!((valid[way / 64] >> (way % 64)) & 1) || !c->dirty[i])
+          continue;
+        c->dirty[i] = 0;
+        hierarchy_write_back(h, l, ((c->tags[i] << c->s) | set) << c->b);
+      }
+    }
+  }
+  h->flush_writebacks = h->mem_writebacks - before;
+}
+
+static int run_hierarchy(trace_t *trace, hierarchy_t *h, int verbose)
+{
+  trace_rec_t rec;
+  while (trace_next(trace, &rec))
+  {
+    char op = rec.op;
+    if (op == 0 || op == 'I')
+      continue;
+    int is_store = (op == 'S' || op == 'M');
+    int accesses = (op == 'M') ? 2 : 1;
+    progress_add(trace, (unsigned long long)accesses);
+    for (int a = 0; a < accesses; ++a)
+    {
+      int level = hierarchy_access(h, rec.addr, is_store);
+      if (verbose)
+      {
+        verbose_access(&verbose_out, op, rec.addr, rec.size);
+        if (level < h->n_levels)
+        {
+          out_char(&verbose_out, 'L');
+          out_dec(&verbose_out, level + 1);
+          out_str(&verbose_out, " hit\n");
+        }
+        else
+          out_str(&verbose_out, "memory\n");
+      }
+    }
+  }
+  return 0;
+}
+
+static void printSummaryHierarchy(const hierarchy_t *h, int traffic)
+{
+  FILE *output_fp = fopen(".csim_results", "w");
+  assert(output_fp);
+  for (int l = 0; l < h->n_levels; ++l)
+  {
+    const cache_t *c = &h->levels[l];
+    printf("L%d s:%d E:%d b:%d ", l + 1, c->s, c->E, c->b);
+    if (c->policy != POLICY_LRU)
+      printf("policy:%s ", policy_names[c->policy]);
+    printf("hits:%llu misses:%llu evictions:%llu", c->hits, c->misses, c->evictions);
+    if (traffic)
+      printf(" dirty_evictions:%llu", c->dirty_evictions);
+    printf("\n");
+    fprintf(output_fp, "%llu %llu %llu\n", c->hits, c->misses, c->evictions);
+  }
+  fclose(output_fp);
+  printf("%s memory_accesses:%llu back_invalidations:%llu\n", inclusion_names[h->inclusion],
+         h->mem_accesses, h->back_invalidations);
+  if (traffic)
+    printf("memory_writebacks:%llu (%llu at exit) bytes_read:%llu bytes_written:%llu\n", h->mem_writebacks,
+           h->flush_writebacks, h->mem_bytes_read, h->mem_bytes_written);
+  printf("cycles:%llu (%.2f per access)\n", h->cycles,
+         h->accesses ? (double)h->cycles / (double)h->accesses : 0.0);
+}
+
+/* Runs the -H mode from start to finish; returns the exit code. */
+static int hierarchy_main(hierarchy_t *h, const char *trace_file, int policy, unsigned long long seed, int verbose,
+                          int traffic)
+{
+  int code = 0;
+  int ready = 0;
+  for (; ready < h->n_levels; ++ready)
+  {
+    cache_t *c = &h->levels[ready];
+    int latency = c->latency;
+    int err = cache_init(c, c->s, c->E, c->b, c->policy < 0 ? policy : c->policy, seed);
+    c->latency = latency;
+    if (err != 0)
+    {
+      if (err == -2)
+        fprintf(stderr, "plru needs a power-of-two E, got %d\n", c->E);
+      else
+        fprintf(stderr, "malloc failed\n");
+      code = err == -2 ? 1 : 2;
+      break;
+    }
+    if (h->inclusion == INCL_EXCLUSIVE && c->b != h->levels[0].b)
+    {
+      fprintf(stderr, "exclusive hierarchies need the same b in every level\n");
+      code = 1;
+      ++ready;
+      break;
+    }
+  }
+
+  trace_t trace;
+  if (code == 0 && open_trace(&trace, trace_file) != 0)
+    code = 1;
+  if (code == 0)
+  {
+    run_hierarchy(&trace, h, verbose);
+    out_flush(&verbose_out);
+    progress_finish();
+    trace_close(&trace);
+    hierarchy_flush(h);
+    printSummaryHierarchy(h, traffic);
+  }
+  while (ready--)
+    cache_free(&h->levels[ready]);
+  free(h->levels);
+  return code;
+}
+
+/*
+ * Multi-core coherence.
+ *
+ * -X gives every core a private cache of the -s/-E/-b geometry and keeps
+ * the caches coherent by snooping MESI or MOESI. A load miss is a bus read
+ * (BusRd), a store miss a read for ownership (BusRdX), and a store hit on a
+ * shared or owned line an upgrade. The other caches react as follows:
+ *
+ *   BusRd     M goes to S and is written back (MESI), or to O and supplies
+ *             the data from then on (MOESI); E goes to S. The requester gets
+ *             E if no other cache holds the block, S otherwise.
+ *   BusRdX,   every other copy is invalidated and the requester gets M. A
+ *   upgrade   dirty copy hands its data over without a write-back.
+ *
+ * A store hit on E goes to M silently. Evicting an M or O line writes it
+ * back; lines still dirty at the end are not counted.
+ *
+ * The cores come either from one -t per core, interleaved one record at a
+ * time (-Q rr) or by their @time prefixes (-Q time, ties go to the lower
+ * core), or from a single trace whose records carry their core id and are
+ * replayed in file order.
+ *
+ * A miss on a block that the core lost to an invalidation, rather than to
+ * an eviction, is a coherence miss. It is a false-sharing miss when no other
+ * core wrote the bytes it touches in the meantime, only their neighbours.
+ * Writes are tracked in sixteenths of a block, and only for blocks that
+ * were invalidated at least once.
+ */
+
+#define COH_MAX_CORES MAX_WORKERS
+#define COH_WORDS 16
+#define COH_HOT_LINES 10
+
+enum
+{
+  COH_I,
+  COH_S,
+  COH_E,
+  COH_O,
+  COH_M
+};
+
+enum
+{
+  COH_MESI,
+  COH_MOESI
+};
+
+static const char *const protocol_names[] = {"mesi", "moesi"};
+
+enum
+{
+  COH_RR,
+  COH_TIME
+};
+
+static const char *const order_names[] = {"rr", "time"};
+
+typedef struct
+{
+  cache_t cache;
+  unsigned char *state; /* COH_* of every line */
+  unsigned long long coherence_misses, false_sharing, invalidations, upgrades, writebacks, transfers;
+} coh_core_t;
+
+/* A block that has been invalidated somewhere. */
+typedef struct
+{
+  unsigned long long block;
+  unsigned long long written[COH_WORDS]; /* time of the last store to every word */
+  unsigned long long invalidations, coherence_misses, false_sharing;
+} coh_line_t;
+
+/* Open-addressing map from (block, core) pairs to 64-bit values. */
+typedef struct
+{
+  unsigned long long *keys, *vals;
+  unsigned char *used; /* core + 1 of the pair in each slot, 0 for empty slots */
+  unsigned long long cap, n;
+} coh_map_t;
+
+typedef struct
+{
+  int protocol, n_cores;
+  int s, E, b, policy;
+  unsigned long long seed;
+  coh_core_t cores[COH_MAX_CORES];
+  coh_line_t *lines;
+  unsigned long long n_lines, lines_cap;
+  coh_map_t line_of; /* (block, 0) -> index + 1 in lines */
+  coh_map_t lost;    /* (block, core) -> time of the invalidation, 0 once missed */
+  unsigned long long now;
+} coh_t;
+
+static unsigned long long *coh_map_slot(coh_map_t *m, unsigned long long block, int core, int create);
+
+static int coh_map_grow(coh_map_t *m)
+{
+  coh_map_t old = *m;
+  m->cap = old.cap ? old.cap * 2 : 1024;
+  m->n = 0;
+  m->keys = (unsigned long long *)malloc(sizeof(unsigned long long) * m->cap);
+  m->vals = (unsigned long long *)malloc(sizeof(unsigned long long) * m->cap);
+  m->used = (unsigned char *)calloc(m->cap, 1);
+  if (!m->keys || !m->vals || !m->used)
+  {
+    free(m->keys);
+    free(m->vals);
+    free(m->used);
+    *m = old;
+    return -1;
+  }
+  for (unsigned long long i = 0; i < old.cap; ++i)
+    if (old.used[i])
+      *coh_map_slot(m, old.keys[i], old.used[i] - 1, 1) = old.vals[i];
+  free(old.keys);
+  free(old.vals);
+  free(old.used);
+  return 0;
+}
+
+/* The value of (block, core), added as 0 if create is set. NULL if absent, or out of memory. */
+static unsigned long long *coh_map_slot(coh_map_t *m, unsigned long long block, int core, int create)
+{
+  if (create && (m->n + 1) * 2 > m->cap && coh_map_grow(m) != 0)
+    return NULL;
+  if (m->cap == 0)
+    return NULL;
+  unsigned long long mask = m->cap - 1;
+  unsigned char tag = (unsigned char)(core + 1);
+  for (unsigned long long i = sd_hash(block ^ sd_hash((unsigned long long)tag)) & mask;; i = (i + 1) & mask)
+  {
+    if (!m->used[i])
+    {
+      if (!create)
+        return NULL;
+      m->used[i] = tag;
+      m->keys[i] = block;
+      m->vals[i] = 0;
+      ++m->n;
+      return &m->vals[i];
+    }
+    if (m->keys[i] == block && m->used[i] == tag)
+      return &m->vals[i];
+  }
+}
+
+static void coh_map_free(coh_map_t *m)
+{
+  free(m->keys);
+  free(m->vals);
+  free(m->used);
+}
+
+/* Gives cores up to and including p their caches. Returns 0, -1 if out of memory, -2 for a plru E. */
+static int coh_add_cores(coh_t *h, int p)
+{
+  for (; h->n_cores <= p; ++h->n_cores)
+  {
+    coh_core_t *core = &h->cores[h->n_cores];
+    int err = cache_init(&core->cache, h->s, h->E, h->b, h->policy, h->seed);
+    if (err != 0)
+      return err;
+    core->state = (unsigned char *)calloc((size_t)core->cache.stride << h->s, 1);
+    if (!core->state)
+    {
+      cache_free(&core->cache);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* The entry of block, created if asked to. NULL if there is none, or out of memory. */
+static coh_line_t *coh_line(coh_t *h, unsigned long long block, int create)
+{
+  unsigned long long *index = coh_map_slot(&h->line_of, block, 0, create);
+  if (!index)
+    return NULL;
+  if (*index == 0)
+  {
+    if (h->n_lines == h->lines_cap)
+    {
+      unsigned long long cap = h->lines_cap ? h->lines_cap * 2 : 256;
+      coh_line_t *grown = (coh_line_t *)realloc(h->lines, sizeof(coh_line_t) * cap);
+      if (!grown)
+        return NULL;
+      h->lines = grown;
+      h->lines_cap = cap;
+    }
+    coh_line_t *line = &h->lines[h->n_lines];
+    memset(line, 0, sizeof(*line));
+    line->block = block;
+    *index = ++h->n_lines;
+  }
+  return &h->lines[*index - 1];
+}
+
+/* Words [*first, *last] of its block that an access of size bytes at addr touches. */
+static inline void coh_words(const coh_t *h, unsigned long long addr, int size, int *first, int *last)
+{
+  int shift = h->b > 4 ? h->b - 4 : 0;
+  unsigned long long offset = addr & ((1ULL << h->b) - 1);
+  unsigned long long end = (offset + (size > 1 ? (unsigned long long)size - 1 : 0)) >> shift;
+  int n_words = (1 << h->b) >> shift;
+  *first = (int)(offset >> shift);
+  *last = end < (unsigned long long)n_words ? (int)end : n_words - 1;
+}
+
+/* BusRd of addr by core p. Returns whether another cache holds the block. */
+static int coh_bus_read(coh_t *h, int p, unsigned long long addr)
+{
+  int shared = 0;
+  for (int q = 0; q < h->n_cores; ++q)
+  {
+    coh_core_t *other = &h->cores[q];
+    long long slot;
+    if (q == p || (slot = cache_lookup(&other->cache, addr)) < 0)
+      continue;
+    shared = 1;
+    unsigned char *state = &other->state[slot];
+    if (*state == COH_M)
+    {
+      ++other->transfers;
+      if (h->protocol == COH_MOESI)
+        *state = COH_O;
+      else
+      {
+        ++other->writebacks;
+        *state = COH_S;
+      }
+    }
+    else if (*state == COH_O)
+      ++other->transfers;
+    else if (*state == COH_E)
+      *state = COH_S;
+  }
+  return shared;
+}
+
+/* BusRdX (miss set) or upgrade of addr by core p: drops every other copy. Returns 0, or -1 if out of memory. */
+static int coh_invalidate_others(coh_t *h, int p, unsigned long long addr, int miss)
+{
+  unsigned long long block = addr >> h->b;
+  for (int q = 0; q < h->n_cores; ++q)
+  {
+    coh_core_t *other = &h->cores[q];
+    long long slot;
+    if (q == p || (slot = cache_lookup(&other->cache, addr)) < 0)
+      continue;
+    if (miss && (other->state[slot] == COH_M || other->state[slot] == COH_O))
+      ++other->transfers;
+    int was_dirty;
+    cache_invalidate(&other->cache, addr, &was_dirty);
+    other->state[slot] = COH_I;
+    ++other->invalidations;
+    coh_line_t *line = coh_line(h, block, 1);
+    unsigned long long *lost = coh_map_slot(&h->lost, block, q, 1);
+    if (!line || !lost)
+      return -1;
+    ++line->invalidations;
+    *lost = h->now;
+  }
+  return 0;
+}
+
+/* One load or store of core p. Returns 0, or -1 if out of memory. */
+static int coh_access(coh_t *h, int p, unsigned long long addr, int size, int is_store)
+{
+  coh_core_t *me = &h->cores[p];
+  unsigned long long block = addr >> h->b;
+  int first, last;
+  coh_words(h, addr, size, &first, &last);
+  ++h->now;
+
+  int result = cache_access(&me->cache, addr, is_store);
+  unsigned char *state = &me->state[me->cache.last_slot];
+  if (result == ACCESS_HIT)
+  {
+    if (is_store && *state != COH_M)
+    {
+      if (*state != COH_E)
+      {
+        ++me->upgrades;
+        if (coh_invalidate_others(h, p, addr, 0) != 0)
+          return -1;
+      }
+      *state = COH_M;
+    }
+  }
+  else
+  {
+    /* the slot still holds the victim's state */
+    if ((result & ACCESS_EVICT) && (*state == COH_M || *state == COH_O))
+      ++me->writebacks;
+    unsigned long long *lost = coh_map_slot(&h->lost, block, p, 0);
+    if (lost && *lost)
+    {
+      coh_line_t *line = coh_line(h, block, 0);
+      int true_sharing = 0;
+      for (int w = first; w <= last; ++w)
+        true_sharing |= line->written[w] >= *lost;
+      ++me->coherence_misses;
+      ++line->coherence_misses;
+      if (!true_sharing)
+      {
+        ++me->false_sharing;
+        ++line->false_sharing;
+      }
+      *lost = 0;
+    }
+    if (is_store)
+    {
+      if (coh_invalidate_others(h, p, addr, 1) != 0)
+        return -1;
+      *state = COH_M;
+    }
+    else
+      *state = coh_bus_read(h, p, addr) ? COH_S : COH_E;
+  }
+
+  if (is_store)
+  {
+    coh_line_t *line = coh_line(h, block, 0);
+    for (int w = first; line && w <= last; ++w)
+      line->written[w] = h->now;
+  }
+  return 0;
+}
+
+static int coh_record(coh_t *h, int p, const trace_rec_t *rec, const trace_t *trace)
+{
+  int is_store = (rec->op == 'S' || rec->op == 'M');
+  int accesses = (rec->op == 'M') ? 2 : 1;
+  progress_add(trace, (unsigned long long)accesses);
+  for (int a = 0; a < accesses; ++a)
+    if (coh_access(h, p, rec->addr, rec->size, is_store) != 0)
+      return -1;
+  return 0;
+}
+
+/* Next load, store or modify of a trace; 0 at its end. */
+static int coh_next(trace_t *trace, trace_rec_t *rec)
+{
+  while (trace_next(trace, rec))
+    if (rec->op != 0 && rec->op != 'I')
+      return 1;
+  return 0;
+}
+
+/* Returns 0, -1 if out of memory, -2 for a bad record (reported here). */
+static int run_coherence(coh_t *h, trace_t *traces, char **trace_files, int n_traces, int order)
+{
+  trace_rec_t rec;
+  if (n_traces == 1)
+  {
+    while (coh_next(&traces[0], &rec))
+    {
+      int p = rec.core < 0 ? 0 : rec.core;
+      if (p >= COH_MAX_CORES)
+      {
+        fprintf(stderr, "%s: core %d out of range (at most %d cores)\n", trace_files[0], p, COH_MAX_CORES);
+        return -2;
+      }
+      int err = coh_add_cores(h, p);
+      if (err == 0)
+        err = coh_record(h, p, &rec, &traces[0]);
+      if (err != 0)
+        return -1;
+    }
+    return 0;
+  }
+
+  /* one pending record per core */
+  trace_rec_t pending[COH_MAX_CORES];
+  int live[COH_MAX_CORES];
+  for (int p = 0; p < n_traces; ++p)
+    live[p] = coh_next(&traces[p], &pending[p]);
+  for (int p = 0;;)
+  {
+    if (order == COH_TIME)
+    {
+      p = -1;
+      for (int q = 0; q < n_traces; ++q)
+      {
+        if (live[q] && pending[q].time == TRACE_TIME_NONE)
+        {
+          fprintf(stderr, "%s: record without a @time\n", trace_files[q]);
+          return -2;
+        }
+        if (live[q] && (p < 0 || pending[q].time < pending[p].time))
+          p = q;
+      }
+      if (p < 0)
+        return 0;
+    }
+    else
+    {
+      int q = 0;
+      while (q < n_traces && !live[(p + q) % n_traces])
+        ++q;
+      if (q == n_traces)
+        return 0;
+      p = (p + q) % n_traces;
+    }
+    if (coh_record(h, p, &pending[p], &traces[p]) != 0)
+      return -1;
+    live[p] = coh_next(&traces[p], &pending[p]);
+    if (order == COH_RR)
+      p = (p + 1) % n_traces;
+  }
+}
+
+static int coh_hotter(const void *a, const void *b)
+{
+  const coh_line_t *x = *(const coh_line_t *const *)a, *y = *(const coh_line_t *const *)b;
+  if (x->false_sharing != y->false_sharing)
+    return x->false_sharing < y->false_sharing ? 1 : -1;
+  if (x->coherence_misses != y->coherence_misses)
+    return x->coherence_misses < y->coherence_misses ? 1 : -1;
+  return x->block < y->block ? -1 : x->block > y->block;
+}
+
+static void printCoherence(const coh_t *h)
+{
+  unsigned long long hits = 0, misses = 0, evictions = 0;
+  coh_core_t total;
+  memset(&total, 0, sizeof(total));
+  for (int p = 0; p < h->n_cores; ++p)
+  {
+    const coh_core_t *core = &h->cores[p];
+    hits += core->cache.hits;
+    misses += core->cache.misses;
+    evictions += core->cache.evictions;
+    total.coherence_misses += core->coherence_misses;
+    total.false_sharing += core->false_sharing;
+    total.invalidations += core->invalidations;
+    total.upgrades += core->upgrades;
+    total.writebacks += core->writebacks;
+    total.transfers += core->transfers;
+  }
+  printSummary(hits, misses, evictions);
+  for (int p = 0; p < h->n_cores; ++p)
+  {
+    const coh_core_t *core = &h->cores[p];
+    printf("core:%d hits:%llu misses:%llu evictions:%llu coherence_misses:%llu false_sharing:%llu "
+           "invalidations:%llu upgrades:%llu writebacks:%llu transfers:%llu\n",
+           p, core->cache.hits, core->cache.misses, core->cache.evictions, core->coherence_misses,
+           core->false_sharing, core->invalidations, core->upgrades, core->writebacks, core->transfers);
+  }
+  printf("protocol:%s coherence_misses:%llu false_sharing:%llu invalidations:%llu upgrades:%llu writebacks:%llu "
+         "transfers:%llu\n",
+         protocol_names[h->protocol], total.coherence_misses, total.false_sharing, total.invalidations,
+         total.upgrades, total.writebacks, total.transfers);
+
+  /* the lines that bounced the most for no shared data */
+  const coh_line_t *hot[COH_HOT_LINES];
+  int n_hot = 0;
+  for (unsigned long long i = 0; i < h->n_lines; ++i)
+  {
+    const coh_line_t *line = &h->lines[i];
+    if (line->false_sharing == 0)
+      continue;
+    int k = n_hot < COH_HOT_LINES ? n_hot++ : COH_HOT_LINES;
+    for (; k > 0 && coh_hotter(&line, &hot[k - 1]) < 0; --k)
+      if (k < COH_HOT_LINES)
+        hot[k] = hot[k - 1];
+    if (k < COH_HOT_LINES)
+      hot[k] = line;
+  }
+  for (int i = 0; i < n_hot; ++i)
+    printf("false_sharing_line:0x%llx invalidations:%llu coherence_misses:%llu false_sharing:%llu\n",
+           hot[i]->block << h->b, hot[i]->invalidations, hot[i]->coherence_misses, hot[i]->false_sharing);
+}
+
+/* Runs the -X mode from start to finish; returns the exit code. */
+static int coherence_main(coh_t *h, char **trace_files, int n_traces, int order)
+{
+  int code = 0;
+  int err = coh_add_cores(h, n_traces > 1 ? n_traces - 1 : 0);
+  if (err != 0)
+  {
+    if (err == -2)
+      fprintf(stderr, "plru needs a power-of-two E, got %d\n", h->E);
+    else
+      fprintf(stderr, "malloc failed\n");
+    code = err == -2 ? 1 : 2;
+  }
+
+  trace_t traces[COH_MAX_CORES];
+  int opened = 0;
+  while (code == 0 && opened < n_traces)
+  {
+    if (open_trace(&traces[opened], trace_files[opened]) != 0)
+      code = 1;
+    else
+      ++opened;
+  }
+  if (code == 0)
+  {
+    err = run_coherence(h, traces, trace_files, n_traces, order);
+    progress_finish();
+    if (err == -1)
+      fprintf(stderr, "malloc failed\n");
+    code = err == -1 ? 2 : err ? 1 : 0;
+  }
+  if (code == 0)
+    printCoherence(h);
+  while (opened--)
+    trace_close(&traces[opened]);
+  for (int p = 0; p < h->n_cores; ++p)
+  {
+    cache_free(&h->cores[p].cache);
+    free(h->cores[p].state);
+  }
+  free(h->lines);
+  coh_map_free(&h->line_of);
+  coh_map_free(&h->lost);
+  return code;
+}
+
+/*
+ * Batch mode.
+ *
+ * -B reads a manifest of "trace <file>" and "config <s,E,b[,policy]> ..."
+ * lines ('#' starts a comment) and simulates every trace under every
+ * configuration. Each trace is cut into groups of configurations that are
+ * simulated together in one pass over it, with enough groups overall to
+ * keep every worker busy; workers take the next group off a shared index
+ * and only hold the caches of the group at hand. The results come out as
+ * one CSV or JSON table in manifest order, whatever the schedule.
+ */
+
+#define SWEEP_GROUPS_PER_WORKER 2
+
+enum
+{
+  SWEEP_OK,
+  SWEEP_UNREADABLE,
+  SWEEP_BAD_VERSION,
+  SWEEP_NO_MEMORY
+};
+
+static const char *const sweep_errors[] = {"", "cannot open trace", "unsupported binary trace version",
+                                           "out of memory"};
+
+typedef struct
+{
+  unsigned long long hits, misses, evictions, dirty_evictions;
+  int status;
+} sweep_row_t;
+
+typedef struct
+{
+  char **traces;
+  int n_traces;
+  cache_t *configs; /* geometry and policy of every configuration */
+  int n_configs;
+  unsigned long long seed;
+  int per_trace; /* groups per trace */
+  int group_len; /* configurations per group */
+  sweep_row_t *rows; /* n_traces * n_configs, trace-major */
+  atomic_int next;   /* next group to simulate */
+} sweep_t;
+
+/* Reads the manifest into s->traces and s->configs. Returns 0, -1 for a bad manifest (reported), -2 if out of memory. */
+static int sweep_read_manifest(sweep_t *s, const char *path)
+{
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+  {
+    fprintf(stderr, "Cannot open manifest: %s\n", path);
+    return -1;
+  }
+  char *line = NULL;
+  size_t cap = 0;
+  int err = 0;
+  for (int lineno = 1; !err && getline(&line, &cap, fp) != -1; ++lineno)
+  {
+    char *p = line + strspn(line, " \t");
+    char *end = p + strlen(p);
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+      *--end = '\0';
+    if (*p == '\0' || *p == '#')
+      continue;
+    size_t word = strcspn(p, " \t");
+    char *arg = p + word + strspn(p + word, " \t");
+    if (word == 5 && strncmp(p, "trace", 5) == 0 && *arg)
+    {
+      char **grown = (char **)realloc(s->traces, sizeof(char *) * (s->n_traces + 1));
+      if (grown)
+        s->traces = grown;
+      if (!grown || !(grown[s->n_traces] = strdup(arg)))
+        err = -2;
+      else
+        ++s->n_traces;
+    }
+    else if (word == 6 && strncmp(p, "config", 6) == 0 && parse_configs(arg, &s->configs, &s->n_configs) == 0)
+      continue;
+    else
+    {
+      fprintf(stderr, "%s:%d: expected 'trace <file>' or 'config <s,E,b[,policy]> ...'\n", path, lineno);
+      err = -1;
+    }
+  }
+  free(line);
+  fclose(fp);
+  if (!err && (s->n_traces == 0 || s->n_configs == 0))
+  {
+    fprintf(stderr, "%s: needs at least one trace and one config\n", path);
+    err = -1;
+  }
+  return err;
+}
+
+static void *sweep_worker(void *arg)
+{
+  sweep_t *s = (sweep_t *)arg;
+  static const analysis_t none;
+  int total = s->n_traces * s->per_trace;
+  for (int g; (g = atomic_fetch_add(&s->next, 1)) < total;)
+  {
+    int t = g / s->per_trace;
+    int first = (g % s->per_trace) * s->group_len;
+    int n = s->n_configs - first < s->group_len ? s->n_configs - first : s->group_len;
+    sweep_row_t *rows = &s->rows[t * s->n_configs + first];
+    cache_t *caches = (cache_t *)calloc(n, sizeof(cache_t));
+    int ready = 0, status = caches ? SWEEP_OK : SWEEP_NO_MEMORY;
+    for (; status == SWEEP_OK && ready < n; ++ready)
+    {
+      const cache_t *k = &s->configs[first + ready];
+      if (cache_init(&caches[ready], k->s, k->E, k->b, k->policy, s->seed) != 0)
+        status = SWEEP_NO_MEMORY;
+    }
+    trace_t trace;
+    if (status == SWEEP_OK)
+    {
+      int err = trace_open(&trace, s->traces[t]);
+      status = err == -2 ? SWEEP_BAD_VERSION : err ? SWEEP_UNREADABLE : SWEEP_OK;
+    }
+    if (status == SWEEP_OK)
+    {
+      trace_rec_t rec;
+      while (trace_next(&trace, &rec))
+        if (rec.op != 0 && rec.op != 'I')
+          simulate_record(caches, n, &none, 0, rec.op, rec.addr, rec.size, rec.reg);
+      trace_close(&trace);
+    }
+    for (int i = 0; i < n; ++i)
+    {
+      rows[i].status = status;
+      if (status == SWEEP_OK)
+      {
+        rows[i].hits = caches[i].hits;
+        rows[i].misses = caches[i].misses;
+        rows[i].evictions = caches[i].evictions;
+        rows[i].dirty_evictions = caches[i].dirty_evictions;
+      }
+    }
+    while (ready--)
+      cache_free(&caches[ready]);
+    free(caches);
+  }
+  return NULL;
+}
+
+/* Writes str as a CSV field, quoted when it has to be. */
+static void csv_field(FILE *fp, const char *str)
+{
+  if (!str[strcspn(str, ",\"\r\n")])
+  {
+    fputs(str, fp);
+    return;
+  }
+  fputc('"', fp);
+  for (; *str; ++str)
+  {
+    if (*str == '"')
+      fputc('"', fp);
+    fputc(*str, fp);
+  }
+  fputc('"', fp);
+}
+
+static void json_string(FILE *fp, const char *str)
+{
+  fputc('"', fp);
+  for (; *str; ++str)
+  {
+    unsigned char ch = (unsigned char)*str;
+    if (ch == '"' || ch == '\\')
+      fprintf(fp, "\\%c", ch);
+    else if (ch < 0x20)
+      fprintf(fp, "\\u%04x", ch);
+    else
+      fputc(ch, fp);
+  }
+  fputc('"', fp);
+}
+
+static void printSweep(FILE *fp, const sweep_t *s, int json)
+{
+  if (json)
+    fputs("[\n", fp);
+  else
+    fputs("trace,s,E,b,policy,hits,misses,evictions,dirty_evictions,miss_ratio,error\n", fp);
+  for (int t = 0; t < s->n_traces; ++t)
+  {
+    for (int i = 0; i < s->n_configs; ++i)
+    {
+      const cache_t *k = &s->configs[i];
+      const sweep_row_t *r = &s->rows[t * s->n_configs + i];
+      unsigned long long accesses = r->hits + r->misses;
+      double ratio = accesses ? (double)r->misses / (double)accesses : 0.0;
+      if (json)
+      {
+        fputs("  {\"trace\": ", fp);
+        json_string(fp, s->traces[t]);
+        fprintf(fp, ", \"s\": %d, \"E\": %d, \"b\": %d, \"policy\": \"%s\"", k->s, k->E, k->b,
+                policy_names[k->policy]);
+        if (r->status == SWEEP_OK)
+          fprintf(fp, ", \"hits\": %llu, \"misses\": %llu, \"evictions\": %llu, \"dirty_evictions\": %llu, "
+                      "\"miss_ratio\": %.6f}",
+                  r->hits, r->misses, r->evictions, r->dirty_evictions, ratio);
+        else
+          fprintf(fp, ", \"error\": \"%s\"}", sweep_errors[r->status]);
+        fputs(t == s->n_traces - 1 && i == s->n_configs - 1 ? "\n" : ",\n", fp);
+      }
+      else
+      {
+        csv_field(fp, s->traces[t]);
+        fprintf(fp, ",%d,%d,%d,%s,", k->s, k->E, k->b, policy_names[k->policy]);
+        if (r->status == SWEEP_OK)
+          fprintf(fp, "%llu,%llu,%llu,%llu,%.6f,\n", r->hits, r->misses, r->evictions, r->dirty_evictions,
+                  ratio);
+        else
+          fprintf(fp, ",,,,,%s\n", sweep_errors[r->status]);
+      }
+    }
+  }
+  if (json)
+    fputs("]\n", fp);
+}
+
+/*
+ * Runs a manifest on n_workers threads (0 for one per CPU) and prints the
+ * table to out_file or stdout. Returns the exit code: 1 if the manifest is
+ * bad or some trace could not be simulated, 2 if out of memory.
+ */
+static int sweep_main(const char *manifest, int json, int policy, unsigned long long seed, int n_workers,
+                      const char *out_file)
+{
+  sweep_t s;
+  memset(&s, 0, sizeof(s));
+  s.seed = seed;
+  int code = 0;
+  int err = sweep_read_manifest(&s, manifest);
+  if (err != 0)
+    code = err == -2 ? 2 : 1;
+  for (int i = 0; i < s.n_configs && code == 0; ++i)
+  {
+    cache_t *k = &s.configs[i];
+    if (k->policy < 0)
+      k->policy = policy;
+    if (k->policy == POLICY_PLRU && (k->E & (k->E - 1)) != 0)
+    {
+      fprintf(stderr, "plru needs a power-of-two E, got %d\n", k->E);
+      code = 1;
+    }
+  }
+  FILE *out = stdout;
+  if (code == 0 && out_file && !(out = fopen(out_file, "w")))
+  {
+    fprintf(stderr, "Cannot create %s\n", out_file);
+    code = 1;
+  }
+
+  if (code == 0)
+  {
+    if (n_workers == 0)
+    {
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      n_workers = cpus < 1 ? 1 : cpus > MAX_WORKERS ? MAX_WORKERS : (int)cpus;
+    }
+    s.per_trace = (SWEEP_GROUPS_PER_WORKER * n_workers + s.n_traces - 1) / s.n_traces;
+    if (s.per_trace > s.n_configs)
+      s.per_trace = s.n_configs;
+    s.group_len = (s.n_configs + s.per_trace - 1) / s.per_trace;
+    s.per_trace = (s.n_configs + s.group_len - 1) / s.group_len;
+    if (n_workers > s.n_traces * s.per_trace)
+      n_workers = s.n_traces * s.per_trace;
+    s.rows = (sweep_row_t *)calloc((size_t)s.n_traces * s.n_configs, sizeof(sweep_row_t));
+    if (!s.rows)
+    {
+      fprintf(stderr, "malloc failed\n");
+      code = 2;
+    }
+  }
+  if (code == 0)
+  {
+    /* build the shared parser table before the workers race to do it */
+    trace_char_class();
+    pthread_t threads[MAX_WORKERS];
+    int started = 0;
+    while (started < n_workers && pthread_create(&threads[started], NULL, sweep_worker, &s) == 0)
+      ++started;
+    if (started == 0)
+      sweep_worker(&s);
+    while (started--)
+      pthread_join(threads[started], NULL);
+    printSweep(out, &s, json);
+    for (int i = 0; i < s.n_traces * s.n_configs; ++i)
+      if (s.rows[i].status != SWEEP_OK)
+        code = s.rows[i].status == SWEEP_NO_MEMORY ? 2 : code ? code : 1;
+    for (int t = 0; t < s.n_traces; ++t)
+    {
+      int status = s.rows[t * s.n_configs].status;
+      if (status == SWEEP_UNREADABLE || status == SWEEP_BAD_VERSION)
+        fprintf(stderr, "%s: %s\n", s.traces[t], sweep_errors[status]);
+    }
+  }
+  if (out && out != stdout && fclose(out) != 0 && code == 0)
+  {
+    fprintf(stderr, "Cannot write %s\n", out_file);
+    code = 1;
+  }
+  for (int t = 0; t < s.n_traces; ++t)
+    free(s.traces[t]);
+  free(s.traces);
+  free(s.configs);
+  free(s.rows);
+  return code;
+}
+
+/* Memory traffic of a single cache level; lines still dirty at the end count as written. */
+static void printTrafficLine(int s, int E, int b, unsigned long long misses, unsigned long long dirty_evictions,
+                             unsigned long long at_exit)
+{
+  unsigned long long block = 1ULL << b;
+  printf("s:%d E:%d b:%d dirty_evictions:%llu dirty_at_exit:%llu bytes_read:%llu bytes_written:%llu\n", s, E, b,
+         dirty_evictions, at_exit, misses * block, (dirty_evictions + at_exit) * block);
+}
+
+static void printTraffic(const cache_t *caches, int n_caches)
+{
+  for (int i = 0; i < n_caches; ++i)
+  {
+    const cache_t *c = &caches[i];
+    printTrafficLine(c->s, c->E, c->b, c->misses, c->dirty_evictions, cache_dirty_lines(c));
+  }
+}
+
+static void printSummaryMulti(const cache_t *caches, int n_caches)
 {
-  printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
   FILE *output_fp = fopen(".csim_results", "w");
   assert(output_fp);
-  fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+  for (int i = 0; i < n_caches; ++i)
+  {
+    const cache_t *c = &caches[i];
+    printf("s:%d E:%d b:%d ", c->s, c->E, c->b);
+    if (c->policy != POLICY_LRU)
+      printf("policy:%s ", policy_names[c->policy]);
+    printf("hits:%llu misses:%llu evictions:%llu\n", c->hits, c->misses, c->evictions);
+    fprintf(output_fp, "%llu %llu %llu\n", c->hits, c->misses, c->evictions);
+  }
   fclose(output_fp);
 }
 
-void printHelp(const char *name)
-{
-  printf(
-      "Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n"
-      "Options:\n"
-      "  -h         Print this help message.\n"
-      "  -v         Optional verbose flag.\n"
-      "  -s <num>   Number of set index bits.\n"
-      "  -E <num>   Number of lines per set.\n"
-      "  -b <num>   Number of block offset bits.\n"
-      "  -t <file>  Trace file.\n\n"
-      "Examples:\n"
-      "  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n"
-      "  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n",
-      name, name, name);
-}
+/*
+ * Runs a plain single configuration from start to finish as a libcachesim
+ * client; returns the exit code. Every other mode drives cache.h directly,
+ * because it needs what the library keeps private: the lines themselves
+ * (analyses, -v, checkpoints, set sampling) or caches shared out to threads.
+ */
+#define PLAIN_BATCH 4096
 
-typedef struct
+static int plain_main(const char *trace_file, const cachesim_config_t *config, int traffic)
 {
-  int valid;
-  unsigned long long tag;
-  unsigned long long lru; 
-  int dirty;
-} line_t;
+  cachesim_t *c;
+  int err = cachesim_create(&c, config);
+  if (err != 0)
+  {
+    if (err == CACHESIM_ERR_NOMEM)
+      fprintf(stderr, "malloc failed\n");
+    else
+      fprintf(stderr, "Invalid cache s:%d E:%d b:%d policy:%s: %s\n", config->s, config->E, config->b,
+              config->policy, cachesim_strerror(err));
+    return err == CACHESIM_ERR_NOMEM ? 2 : 1;
+  }
+  trace_t trace;
+  if (open_trace(&trace, trace_file) != 0)
+  {
+    cachesim_destroy(c);
+    return 1;
+  }
+
+  static cachesim_ref_t refs[PLAIN_BATCH];
+  size_t n = 0;
+  trace_rec_t rec;
+  while (trace_next(&trace, &rec))
+  {
+    if (rec.op == 0 || rec.op == 'I')
+      continue;
+    progress_add(&trace, rec.op == 'M' ? 2 : 1);
+    refs[n].addr = rec.addr;
+    refs[n].op = rec.op;
+    if (++n == PLAIN_BATCH)
+    {
+      cachesim_access_batch(c, refs, n, NULL);
+      n = 0;
+    }
+  }
+  cachesim_access_batch(c, refs, n, NULL);
+  trace_close(&trace);
+  progress_finish();
+
+  cachesim_stats_t stats;
+  cachesim_get_stats(c, &stats);
+  printSummary(stats.hits, stats.misses, stats.evictions);
+  if (traffic)
+    printTrafficLine(config->s, config->E, config->b, stats.misses, stats.dirty_evictions, stats.dirty_lines);
+  cachesim_destroy(c);
+  return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -48,8 +3440,42 @@ int main(int argc, char *argv[])
   char *trace_file = NULL;
   int verbose = 0;
   int opt;
+  cache_t *caches = NULL;
+  int n_caches = 0;
+  int multi = 0;
+  int mrc_max_E = 0;
+  int policy = POLICY_LRU;
+  unsigned long long seed = 1;
+  int n_workers = 1;
+  int pipelined = 0;
+  hierarchy_t hier;
+  memset(&hier, 0, sizeof(hier));
+  hier.mem_latency = 100;
+  int traffic = 0;
+  int classify = 0;
+  verbose_out.fp = stdout;
+  const char *events_file = NULL;
+  const char *prefetch_arg = NULL;
+  int show_progress = 0;
+  int victim_entries = 0, miss_entries = 0;
+  double sample_fraction = 0.0;
+  prefetch_spec_t prefetch_spec = {0};
+  const char *window_arg = NULL, *window_file = NULL;
+  const char *attrib_arg = NULL;
+  attrib_t attrib;
+  checkpoint_t ckpt;
+  memset(&ckpt, 0, sizeof(ckpt));
+  const char *resume_file = NULL;
+  int status = 0;
+  const char *batch_file = NULL;
+  int json = -1;
+  int workers_given = 0;
+  int protocol = -1, order = -1;
+  int reuse_hist = 0;
+  char *trace_files[COH_MAX_CORES];
+  int n_trace_files = 0;
 
-  while ((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1)
+  while ((opt = getopt(argc, argv, "hvgs:E:b:c:m:p:r:j:PH:i:l:wW:a:3De:T:o:f:V:M:S:C:R:B:F:X:Q:t:")) != -1)
   {
     switch (opt)
     {
@@ -59,6 +3485,9 @@ int main(int argc, char *argv[])
     case 'v':
       verbose = 1;
       break;
+    case 'g':
+      show_progress = 1;
+      break;
     case 's':
       s = atoi(optarg);
       break;
@@ -68,8 +3497,145 @@ int main(int argc, char *argv[])
     case 'b':
       b = atoi(optarg);
       break;
+    case 'c':
+      multi = 1;
+      if (parse_configs(optarg, &caches, &n_caches) != 0)
+      {
+        fprintf(stderr, "Invalid cache configuration: %s\n", optarg);
+        free(caches);
+        return 1;
+      }
+      break;
+    case 'm':
+      mrc_max_E = atoi(optarg);
+      break;
+    case 'p':
+      if ((policy = parse_policy(optarg)) < 0)
+      {
+        fprintf(stderr, "Unknown replacement policy: %s\n", optarg);
+        free(caches);
+        return 1;
+      }
+      break;
+    case 'r':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'j':
+      n_workers = atoi(optarg);
+      workers_given = 1;
+      break;
+    case 'P':
+      pipelined = 1;
+      break;
+    case 'H':
+      if (parse_configs(optarg, &hier.levels, &hier.n_levels) != 0)
+      {
+        fprintf(stderr, "Invalid cache level: %s\n", optarg);
+        free(caches);
+        free(hier.levels);
+        return 1;
+      }
+      break;
+    case 'i':
+      hier.inclusion = -1;
+      for (int k = 0; k < 3; ++k)
+        if (strcmp(optarg, inclusion_names[k]) == 0)
+          hier.inclusion = k;
+      break;
+    case 'l':
+      hier.mem_latency = atoi(optarg);
+      break;
+    case 'w':
+      traffic = 1;
+      break;
+    case 'W':
+      hier.wb_latency = atoi(optarg);
+      break;
+    case '3':
+      classify = 1;
+      break;
+    case 'D':
+      reuse_hist = 1;
+      break;
+    case 'e':
+      events_file = optarg;
+      break;
+    case 'f':
+      prefetch_arg = optarg;
+      if (parse_prefetch(optarg, &prefetch_spec) != 0)
+      {
+        fprintf(stderr, "Invalid prefetcher: %s\n", optarg);
+        free(caches);
+        free(hier.levels);
+        return 1;
+      }
+      break;
+    case 'T':
+      window_arg = optarg;
+      break;
+    case 'V':
+      victim_entries = atoi(optarg);
+      break;
+    case 'S':
+      sample_fraction = strtod(optarg, NULL);
+      if (sample_fraction <= 0.0)
+        sample_fraction = -1.0;
+      break;
+    case 'M':
+      miss_entries = atoi(optarg);
+      break;
+    case 'o':
+      window_file = optarg;
+      break;
+    case 'a':
+      attrib_arg = optarg;
+      if (attrib_init(&attrib, optarg) != 0)
+      {
+        fprintf(stderr, "Invalid matrix sizes: %s\n", optarg);
+        free(caches);
+        free(hier.levels);
+        return 1;
+      }
+      break;
+    case 'C':
+      if (checkpoint_parse(&ckpt, optarg) != 0)
+      {
+        fprintf(stderr, "Invalid checkpoint: %s\n", optarg);
+        free(caches);
+        free(hier.levels);
+        return 1;
+      }
+      break;
+    case 'R':
+      resume_file = optarg;
+      break;
+    case 'B':
+      batch_file = optarg;
+      break;
+    case 'F':
+      json = strcmp(optarg, "json") == 0 ? 1 : strcmp(optarg, "csv") == 0 ? 0 : -2;
+      break;
+    case 'X':
+      protocol = -2;
+      for (int k = 0; k < 2; ++k)
+        if (strcmp(optarg, protocol_names[k]) == 0)
+          protocol = k;
+      break;
+    case 'Q':
+      order = -2;
+      for (int k = 0; k < 2; ++k)
+        if (strcmp(optarg, order_names[k]) == 0)
+          order = k;
+      break;
     case 't':
-      trace_file = optarg;
+      if (n_trace_files == COH_MAX_CORES)
+      {
+        fprintf(stderr, "At most %d trace files\n", COH_MAX_CORES);
+        free(caches);
+        free(hier.levels);
+        return 1;
+      }
+      trace_file = trace_files[n_trace_files++] = optarg;
       break;
     default:
       printHelp(argv[0]);
@@ -77,122 +3643,334 @@ int main(int argc, char *argv[])
     }
   }
 
-  if (s < 0 || E <= 0 || b < 0 || trace_file == NULL)
+  int trace_file_given = trace_file != NULL;
+  if (trace_file == NULL && !isatty(STDIN_FILENO))
+    trace_file = "-";
+  progress_start(show_progress);
+
+  /* per-access models and analyses, which run on the simulating thread */
+  int per_access = attrib_arg || classify || reuse_hist || events_file || window_arg || prefetch_arg ||
+                   victim_entries || miss_entries;
+  int checkpointing = ckpt.path || resume_file;
+
+  if (protocol != -1)
+  {
+    if (protocol < 0 || order == -2 || s < 0 || E <= 0 || b < 0 || multi || hier.n_levels || mrc_max_E ||
+        n_workers != 1 || pipelined || per_access || sample_fraction != 0.0 || checkpointing || verbose ||
+        traffic || batch_file || json != -1 || trace_file == NULL || (order != -1 && n_trace_files < 2))
+    {
+      printHelp(argv[0]);
+      free(caches);
+      free(hier.levels);
+      return 1;
+    }
+    if (n_trace_files == 0)
+      trace_files[n_trace_files++] = trace_file;
+    static coh_t coh;
+    coh.protocol = protocol;
+    coh.s = s;
+    coh.E = E;
+    coh.b = b;
+    coh.policy = policy;
+    coh.seed = seed;
+    return coherence_main(&coh, trace_files, n_trace_files, order < 0 ? COH_RR : order);
+  }
+
+  if (batch_file)
+  {
+    if (s != -1 || E != -1 || b != -1 || multi || hier.n_levels || mrc_max_E || pipelined || per_access ||
+        sample_fraction != 0.0 || checkpointing || verbose || traffic || trace_file_given || json == -2 ||
+        order != -1 || n_workers < 1 || n_workers > MAX_WORKERS)
+    {
+      printHelp(argv[0]);
+      free(caches);
+      free(hier.levels);
+      return 1;
+    }
+    return sweep_main(batch_file, json == 1, policy, seed, workers_given ? n_workers : 0, window_file);
+  }
+
+  if (hier.n_levels > 0)
+  {
+    if (s != -1 || E != -1 || b != -1 || multi || mrc_max_E || n_workers != 1 || pipelined || per_access ||
+        sample_fraction != 0.0 || checkpointing || hier.inclusion < 0 || order != -1 || n_trace_files > 1 ||
+        trace_file == NULL)
+    {
+      printHelp(argv[0]);
+      free(caches);
+      free(hier.levels);
+      return 1;
+    }
+    return hierarchy_main(&hier, trace_file, policy, seed, verbose, traffic);
+  }
+
+  /* a resumed run takes its configurations from the checkpoint */
+  trace_pos_t resume_pos;
+  ckpt_ident_t resume_id;
+  if (resume_file)
+  {
+    if (s != -1 || E != -1 || b != -1 || multi)
+    {
+      printHelp(argv[0]);
+      free(caches);
+      return 1;
+    }
+    int err = checkpoint_load(resume_file, &caches, &n_caches, &multi, &resume_pos, &resume_id);
+    if (err != 0)
+    {
+      if (err == -2)
+        fprintf(stderr, "malloc failed\n");
+      else
+        fprintf(stderr, "Cannot restore checkpoint: %s\n", resume_file);
+      return err == -2 ? 2 : 1;
+    }
+  }
+
+  int single = (s >= 0 && E > 0 && b >= 0);
+  if ((!single && !multi && !resume_file) || (!single && (s != -1 || E != -1 || b != -1)) || mrc_max_E < 0 ||
+      n_workers < 1 || n_workers > MAX_WORKERS || (verbose && n_workers > 1) ||
+      (pipelined && n_workers > 1) || victim_entries < 0 || miss_entries < 0 || (per_access && n_workers > 1) ||
+      sample_fraction < 0.0 || sample_fraction > 1.0 ||
+      (sample_fraction > 0.0 && (n_workers > 1 || pipelined || verbose || per_access || mrc_max_E || traffic)) ||
+      (checkpointing && (n_workers > 1 || pipelined || per_access || mrc_max_E || sample_fraction != 0.0)) ||
+      json != -1 || order != -1 || n_trace_files > 1 || trace_file == NULL)
   {
     printHelp(argv[0]);
+    free(caches);
     return 1;
   }
 
-  unsigned long long S = 1ULL << s;
-  line_t *cache = (line_t *)malloc(sizeof(line_t) * S * E);
-  if (!cache)
+  if (single && !multi && !checkpointing && !per_access && !mrc_max_E && !verbose && !pipelined && n_workers == 1 &&
+      sample_fraction == 0.0)
   {
-    fprintf(stderr, "malloc failed\n");
-    return 2;
+    free(caches);
+    cachesim_config_t config = {s, E, b, policy_names[policy], seed};
+    return plain_main(trace_file, &config, traffic);
+  }
+
+  /* -s/-E/-b, when given, is the first configuration */
+  if (single)
+  {
+    cache_t *grown = (cache_t *)realloc(caches, sizeof(cache_t) * (n_caches + 1));
+    if (!grown)
+    {
+      fprintf(stderr, "malloc failed\n");
+      free(caches);
+      return 2;
+    }
+    caches = grown;
+    memmove(caches + 1, caches, sizeof(cache_t) * n_caches);
+    caches[0].s = s;
+    caches[0].E = E;
+    caches[0].b = b;
+    caches[0].policy = -1;
+    ++n_caches;
   }
-  for (unsigned long long i = 0; i < S * (unsigned long long)E; ++i)
+  for (int i = 0; i < n_caches && !resume_file; ++i)
   {
-    cache[i].valid = 0;
-    cache[i].tag = 0;
-    cache[i].lru = 0;
-    cache[i].dirty = 0;
+    cache_t *c = &caches[i];
+    int err = cache_init(c, c->s, c->E, c->b, c->policy < 0 ? policy : c->policy, seed);
+    if (err != 0)
+    {
+      if (err == -2)
+        fprintf(stderr, "plru needs a power-of-two E, got %d\n", c->E);
+      else
+        fprintf(stderr, "malloc failed\n");
+      while (i--)
+        cache_free(&caches[i]);
+      free(caches);
+      return err == -2 ? 1 : 2;
+    }
   }
 
-  FILE *fp = fopen(trace_file, "r");
-  if (!fp)
+  mrc_t mrc;
+  analysis_t an = {NULL, NULL, attrib_arg ? &attrib : NULL, NULL, NULL, NULL, NULL, 0, NULL};
+  reuse_t reuse;
+  window_t window;
+  int init_err = 0;
+  if (mrc_max_E > 0)
   {
-    fprintf(stderr, "Cannot open trace file: %s\n", trace_file);
-    free(cache);
-    return 1;
+    if (mrc_init(&mrc, caches[0].s, caches[0].b, mrc_max_E) == 0)
+      an.mrc = &mrc;
+    else
+      init_err = 1;
+  }
+  if (reuse_hist && !init_err)
+  {
+    if (reuse_init(&reuse, caches[0].b, an.attrib) == 0)
+      an.reuse = &reuse;
+    else
+      init_err = 1;
+  }
+  if (prefetch_arg && !init_err)
+  {
+    an.prefetch = (prefetcher_t *)calloc(n_caches, sizeof(prefetcher_t));
+    init_err = !an.prefetch;
+    for (int i = 0; i < n_caches && !init_err; ++i)
+      init_err = prefetcher_init(&an.prefetch[i], &prefetch_spec, &caches[i]) != 0;
+  }
+  if ((victim_entries || miss_entries) && !init_err)
+  {
+    int kinds[2], entries[2];
+    if (victim_entries)
+    {
+      kinds[an.n_sides] = SIDE_VICTIM;
+      entries[an.n_sides++] = victim_entries;
+    }
+    if (miss_entries)
+    {
+      kinds[an.n_sides] = SIDE_MISS;
+      entries[an.n_sides++] = miss_entries;
+    }
+    an.side = (side_cache_t *)calloc((size_t)an.n_sides * n_caches, sizeof(side_cache_t));
+    init_err = !an.side;
+    for (int k = 0; k < an.n_sides && !init_err; ++k)
+      for (int i = 0; i < n_caches && !init_err; ++i)
+        init_err = side_init(&an.side[k * n_caches + i], kinds[k], entries[k], &caches[i]) != 0;
+  }
+  if (classify && !init_err)
+  {
+    an.classify = (classify_t *)calloc(n_caches, sizeof(classify_t));
+    init_err = !an.classify;
+    for (int i = 0; i < n_caches && !init_err; ++i)
+      init_err = classify_init(&an.classify[i], &caches[i]) != 0;
   }
 
-  char linebuf[256];
-  int hits = 0, misses = 0, evictions = 0;
-  unsigned long long use_clock = 1;
+  if (window_arg && !init_err)
+  {
+    an.window = &window;
+    int err = window_init(&window, window_arg, window_file, n_caches);
+    if (err == -1)
+      fprintf(stderr, "Invalid window: %s\n", window_arg);
+    else if (err == -2)
+      fprintf(stderr, "Cannot create %s\n", window_file);
+    init_err = err == -3 ? 1 : err ? -2 : 0;
+  }
+  static outbuf_t events;
+  if (events_file && !init_err)
+  {
+    if (events_open(&events, events_file) == 0)
+      an.events = &events;
+    else
+      init_err = -1;
+  }
 
-  while (fgets(linebuf, sizeof(linebuf), fp) != NULL)
+  trace_t trace;
+  if (init_err || open_trace(&trace, trace_file) != 0)
   {
-    char op;
-    unsigned long long addr;
-    int size;
-    if (sscanf(linebuf, " %c %llx,%d", &op, &addr, &size) < 1)
-      continue;
-    if (op == 'I')
-      continue;
+    if (init_err == -1)
+      fprintf(stderr, "Cannot create event log: %s\n", events_file);
+    else if (init_err > 0)
+      fprintf(stderr, "malloc failed\n");
+    if (an.events)
+      events_close(an.events);
+    analysis_free(&an, n_caches);
+    for (int i = 0; i < n_caches; ++i)
+      cache_free(&caches[i]);
+    free(caches);
+    return init_err > 0 ? 2 : 1;
+  }
 
-    int accesses = (op == 'M') ? 2 : 1;
-    for (int a = 0; a < accesses; ++a)
+  if (resume_file && (trace_seek(&trace, &resume_pos) != 0 || !ckpt_matches(&trace, &resume_id)))
+  {
+    fprintf(stderr, "Checkpoint %s does not fit trace %s\n", resume_file, trace_file);
+    return 1;
+  }
+  if (ckpt.path)
+  {
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+  }
+
+  sample_t *samples = NULL;
+  if (sample_fraction > 0.0)
+  {
+    samples = (sample_t *)calloc(n_caches, sizeof(sample_t));
+    int err = !samples;
+    for (int i = 0; i < n_caches && !err; ++i)
+      err = sample_init(&samples[i], &caches[i], sample_fraction, seed) != 0;
+    if (err)
     {
-      unsigned long long set_idx = (addr >> b) & ((1ULL << s) - 1);
-      unsigned long long tag = addr >> (s + b);
-      unsigned long long base = set_idx * (unsigned long long)E;
-      int hit_idx = -1;
-      int empty_idx = -1;
-      unsigned long long lru_min = (unsigned long long)(-1);
-      int lru_idx = -1;
-      for (int i = 0; i < E; ++i)
-      {
-        line_t *ln = &cache[base + i];
-        if (ln->valid)
-        {
-          if (ln->tag == tag)
-          {
-            hit_idx = i;
-            break;
-          }
-          if (ln->lru < lru_min)
-          {
-            lru_min = ln->lru;
-            lru_idx = i;
-          }
-        }
-        else
-        {
-          if (empty_idx == -1)
-            empty_idx = i;
-        }
-      }
+      fprintf(stderr, "malloc failed\n");
+      return 2;
+    }
+  }
 
-      if (hit_idx != -1)
-      {
-        hits++;
-        cache[base + hit_idx].lru = use_clock++;
-        if (op == 'S' || op == 'M')
-          cache[base + hit_idx].dirty = 1;
-        if (verbose)
-        {
-          printf("%c %llx,%d hit\n", op, addr, size);
-        }
-      }
-      else
-      {
-        misses++;
-        if (verbose)
-        {
-          printf("%c %llx,%d miss\n", op, addr, size);
-        }
-        int place = -1;
-        if (empty_idx != -1)
-        {
-          place = empty_idx;
-        }
-        else
-        {
-          evictions++;
-          place = lru_idx;
-        }
-        line_t *ln = &cache[base + place];
-        ln->valid = 1;
-        ln->tag = tag;
-        ln->lru = use_clock++;
-        ln->dirty = (op == 'S' || op == 'M') ? 1 : 0;
-      }
-    } 
+  int run_err;
+  if (samples)
+  {
+    run_err = sample_plan(&trace, caches, n_caches, samples);
+    if (run_err == 0)
+      run_err = run_sampled(&trace, caches, n_caches, samples);
+  }
+  else if (n_workers > 1)
+    run_err = run_sharded(&trace, caches, n_caches, an.mrc, n_workers);
+  else if (pipelined)
+    run_err = run_pipelined(&trace, caches, n_caches, &an, verbose);
+  else
+    run_err = run_serial(&trace, caches, n_caches, &an, verbose, ckpt.records);
+  if (run_err != 0)
+  {
+    fprintf(stderr, run_err == -2 ? "Cannot start threads\n" : "malloc failed\n");
+    return 2;
+  }
+  if (ckpt.path)
+  {
+    if (checkpoint_save(ckpt.path, caches, n_caches, multi, &trace) != 0)
+    {
+      fprintf(stderr, "Cannot write checkpoint: %s\n", ckpt.path);
+      status = 1;
+    }
+    else if (stop_requested == 2)
+      fprintf(stderr, "Interrupted; checkpoint saved to %s\n", ckpt.path);
   }
 
-  fclose(fp);
-  free(cache);
+  trace_close(&trace);
+  out_flush(&verbose_out);
+  progress_finish();
+  if (an.window)
+    window_emit(an.window, caches, n_caches);
+  for (int i = 0; an.prefetch && i < n_caches; ++i)
+    prefetcher_finish(&an.prefetch[i], &caches[i]);
+  if (an.events && events_close(an.events) != 0)
+  {
+    fprintf(stderr, "Cannot write event log: %s\n", events_file);
+    an.events = NULL;
+  }
 
-  printSummary(hits, misses, evictions);
-  return 0;
+  /* sampled runs report estimates in place of the counts */
+  for (int i = 0; samples && i < n_caches; ++i)
+    sample_estimate(&samples[i], &caches[i]);
+  if (multi)
+    printSummaryMulti(caches, n_caches);
+  else
+    printSummary(caches[0].hits, caches[0].misses, caches[0].evictions);
+  if (samples)
+  {
+    for (int i = 0; i < n_caches; ++i)
+    {
+      printSample(&samples[i], &caches[i]);
+      sample_free(&samples[i]);
+    }
+    free(samples);
+  }
+  if (traffic)
+    printTraffic(caches, n_caches);
+  if (an.side)
+    printSideCaches(caches, an.side, an.n_sides, n_caches);
+  if (an.prefetch)
+    printPrefetch(caches, an.prefetch, n_caches);
+  if (an.classify)
+    printClassification(caches, an.classify, n_caches);
+  if (an.attrib)
+    printAttribution(an.attrib);
+  if (an.mrc)
+    printMissRatioCurve(an.mrc);
+  if (an.reuse)
+    printReuseDistance(an.reuse);
+  analysis_free(&an, n_caches);
+  for (int i = 0; i < n_caches; ++i)
+    cache_free(&caches[i]);
+  free(caches);
+  return status;
 }
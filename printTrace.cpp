@@ -2,9 +2,13 @@
 
 int main(int argc, char **argv)
 {
-  if (argc != 2)
+  if (argc == 3 && std::string(argv[2]) == "-b")
   {
-    throw std::runtime_error("Usage: ./printTrace case0/case1/case2/case2");
+    binary_log = true;
+  }
+  else if (argc != 2)
+  {
+    throw std::runtime_error("Usage: ./printTrace case0/case1/case2/case2 [-b]");
   }
   if (std::string(argv[1]) == "case0")
   {
@@ -40,6 +44,6 @@ int main(int argc, char **argv)
   }
   else
   {
-    throw std::runtime_error("Usage: ./printTrace case0/case1/case2/case2");
+    throw std::runtime_error("Usage: ./printTrace case0/case1/case2/case2 [-b]");
   }
 }
\ No newline at end of file
@@ -0,0 +1,213 @@
+#pragma once
+/*
+ * LRU stack distance (Mattson) engine.
+ *
+ * For a fixed number of set bits s and block bits b, the stack distance of
+ * an access is the number of distinct other blocks of the same set touched
+ * since the previous access to its block. An access hits in an LRU cache
+ * with E ways exactly when its distance is below E, so one pass yields the
+ * hit count of every associativity at once.
+ *
+ * Each set keeps a Fenwick tree over set-local timestamps in which only the
+ * most recent access of every block is marked; the distance is the number
+ * of marks after the block's previous timestamp. When a set runs out of
+ * timestamps, its live blocks are renumbered densely, so memory stays
+ * proportional to the number of distinct blocks rather than accesses.
+ *
+ * With s = 0 the engine measures plain reuse distance over the whole trace.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SD_COLD (-1LL)
+#define SD_NO_OWNER (~0ULL)
+
+typedef struct
+{
+  unsigned *tree;           /* Fenwick tree, 1-based, cap entries */
+  unsigned long long *owner; /* block that owns each timestamp, or SD_NO_OWNER */
+  unsigned cap;
+  unsigned now;  /* next free timestamp */
+  unsigned live; /* distinct blocks seen in this set */
+} sd_set_t;
+
+typedef struct
+{
+  unsigned long long key; /* block number + 1, 0 for empty slots */
+  unsigned time;
+} sd_slot_t;
+
+typedef struct
+{
+  int s, b;
+  sd_set_t *sets;
+  sd_slot_t *slots; /* open addressing map from block to its last timestamp */
+  unsigned long long n_slots, n_used;
+} stackdist_t;
+
+static inline int stackdist_init(stackdist_t *sd, int s, int b)
+{
+  memset(sd, 0, sizeof(*sd));
+  sd->s = s;
+  sd->b = b;
+  sd->sets = (sd_set_t *)calloc(1ULL << s, sizeof(sd_set_t));
+  sd->n_slots = 1024;
+  sd->slots = (sd_slot_t *)calloc(sd->n_slots, sizeof(sd_slot_t));
+  if (!sd->sets || !sd->slots)
+  {
+    free(sd->sets);
+    free(sd->slots);
+    memset(sd, 0, sizeof(*sd));
+    return -1;
+  }
+  return 0;
+}
+
+static inline void stackdist_free(stackdist_t *sd)
+{
+  if (sd->sets)
+  {
+    for (unsigned long long i = 0; i < (1ULL << sd->s); ++i)
+    {
+      free(sd->sets[i].tree);
+      free(sd->sets[i].owner);
+    }
+  }
+  free(sd->sets);
+  free(sd->slots);
+  memset(sd, 0, sizeof(*sd));
+}
+
+static inline unsigned long long sd_hash(unsigned long long key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static inline sd_slot_t *sd_lookup(stackdist_t *sd, unsigned long long block)
+{
+  unsigned long long key = block + 1;
+  unsigned long long mask = sd->n_slots - 1;
+  unsigned long long i = sd_hash(key) & mask;
+  while (sd->slots[i].key != key && sd->slots[i].key != 0)
+    i = (i + 1) & mask;
+  return &sd->slots[i];
+}
+
+static inline int sd_grow_map(stackdist_t *sd)
+{
+  sd_slot_t *old = sd->slots;
+  unsigned long long old_n = sd->n_slots;
+  sd->n_slots = old_n * 2;
+  sd->slots = (sd_slot_t *)calloc(sd->n_slots, sizeof(sd_slot_t));
+  if (!sd->slots)
+  {
+    sd->slots = old;
+    sd->n_slots = old_n;
+    return -1;
+  }
+  for (unsigned long long i = 0; i < old_n; ++i)
+    if (old[i].key)
+      *sd_lookup(sd, old[i].key - 1) = old[i];
+  free(old);
+  return 0;
+}
+
+static inline void sd_fenwick_add(sd_set_t *set, unsigned pos, int delta)
+{
+  for (unsigned i = pos + 1; i <= set->cap; i += i & -i)
+    set->tree[i - 1] += (unsigned)delta;
+}
+
+/* Number of marked timestamps in [0, pos]. */
+static inline unsigned sd_fenwick_prefix(const sd_set_t *set, unsigned pos)
+{
+  unsigned sum = 0;
+  for (unsigned i = pos + 1; i > 0; i -= i & -i)
+    sum += set->tree[i - 1];
+  return sum;
+}
+
+/* Renumbers the live blocks of a full set to 0..live-1, growing it if more than half full. */
+static inline int sd_compact(stackdist_t *sd, sd_set_t *set)
+{
+  unsigned cap = set->cap ? set->cap : 8;
+  if (set->live * 2 > cap)
+    cap *= 2;
+  unsigned *tree = (unsigned *)calloc(cap, sizeof(unsigned));
+  unsigned long long *owner = (unsigned long long *)malloc(sizeof(unsigned long long) * cap);
+  if (!tree || !owner)
+  {
+    free(tree);
+    free(owner);
+    return -1;
+  }
+  unsigned n = 0;
+  for (unsigned i = 0; i < set->now; ++i)
+  {
+    if (set->owner[i] == SD_NO_OWNER)
+      continue;
+    sd_lookup(sd, set->owner[i])->time = n;
+    owner[n] = set->owner[i];
+    tree[n] = 1;
+    ++n;
+  }
+  for (unsigned i = n; i < cap; ++i)
+    owner[i] = SD_NO_OWNER;
+  /* linear-time Fenwick build from the 0/1 marks */
+  for (unsigned i = 1; i <= cap; ++i)
+  {
+    unsigned parent = i + (i & -i);
+    if (parent <= cap)
+      tree[parent - 1] += tree[i - 1];
+  }
+  free(set->tree);
+  free(set->owner);
+  set->tree = tree;
+  set->owner = owner;
+  set->cap = cap;
+  set->now = n;
+  return 0;
+}
+
+/*
+ * Records an access and returns its stack distance within its set, or
+ * SD_COLD for the first touch of a block. Returns -2 if memory runs out.
+ */
+static inline long long stackdist_access(stackdist_t *sd, unsigned long long addr)
+{
+  unsigned long long block = addr >> sd->b;
+  sd_set_t *set = &sd->sets[block & ((1ULL << sd->s) - 1)];
+  if (set->now == set->cap && sd_compact(sd, set) != 0)
+    return -2;
+
+  sd_slot_t *slot = sd_lookup(sd, block);
+  long long dist;
+  if (slot->key)
+  {
+    dist = (long long)(set->live - sd_fenwick_prefix(set, slot->time));
+    sd_fenwick_add(set, slot->time, -1);
+    set->owner[slot->time] = SD_NO_OWNER;
+  }
+  else
+  {
+    dist = SD_COLD;
+    if ((sd->n_used + 1) * 2 > sd->n_slots)
+    {
+      if (sd_grow_map(sd) != 0)
+        return -2;
+      slot = sd_lookup(sd, block);
+    }
+    slot->key = block + 1;
+    ++sd->n_used;
+    ++set->live;
+  }
+  slot->time = set->now;
+  set->owner[set->now] = block;
+  sd_fenwick_add(set, set->now, 1);
+  ++set->now;
+  return dist;
+}
@@ -0,0 +1,27 @@
+import tempfile
+from utils import *
+
+
+def test_attribution(case="case3", sizes="29,35,29"):
+    build()
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        trace_file = gemm_trace(case, tmp)
+        for s, E, b in configs:
+            lines = csim_output(f"-s {s} -E {E} -b {b} -a {sizes} -t {trace_file}").splitlines()
+            total = [int(f.split(":")[1]) for f in lines[0].split()]
+            sums = {"region": [0, 0, 0], "reg": [0, 0, 0]}
+            evicted = 0
+            for line in lines[1:]:
+                fields = dict(f.split(":") for f in line.split() if ":" in f)
+                row = [int(fields[k]) for k in ("hits", "misses", "evictions")]
+                kind = line.split()[0]
+                sums[kind] = [x + y for x, y in zip(sums[kind], row)]
+                evicted += int(fields.get("evicted", 0))
+            ok = sums["region"] == total and sums["reg"] == total and evicted == total[2]
+            results.append(("OK " if ok else "ERROR", case, s, E, b))
+    check_table(["status", "case", "s", "E", "b"], results)
+
+
+if __name__ == "__main__":
+    test_attribution()
@@ -0,0 +1,33 @@
+import json
+import tempfile
+from utils import *
+
+
+def test_batch():
+    build()
+    policies = ["lru", "fifo", "random", "brrip"]
+    entries = [(s, E, b, p) for s, E, b in configs for p in policies]
+    with tempfile.TemporaryDirectory() as tmp:
+        manifest = f"{tmp}/batch_test.txt"
+        with open(manifest, "w") as f:
+            f.write("# every trace under every config\n")
+            for trace_file in trace_files:
+                f.write(f"trace {trace_file}\n")
+            for s, E, b, p in entries:
+                f.write(f"config {s},{E},{b},{p}\n")
+        rows = json.loads(csim_output(f"-B {manifest} -F json -j 3"))
+    results = []
+    for trace_file in trace_files:
+        for s, E, b, p in entries:
+            row = rows.pop(0)
+            (single,) = csim_results(f"-s {s} -E {E} -b {b} -p {p} -t {trace_file}")
+            batch = (row["hits"], row["misses"], row["evictions"])
+            ok = (row["trace"], row["s"], row["E"], row["b"], row["policy"]) == (trace_file, s, E, b, p)
+            ok = ok and batch == single
+            results.append(("OK " if ok else "ERROR", trace_file, (s, E, b, p), single, batch))
+    assert not rows
+    check_table(["status", "trace_file", "config", "single", "batch"], results)
+
+
+if __name__ == "__main__":
+    test_batch()
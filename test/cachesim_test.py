@@ -0,0 +1,119 @@
+import ctypes
+import subprocess
+from utils import *
+
+trace_files = [
+    "traces/yi2.trace",
+    "traces/yi.trace",
+    "traces/dave.trace",
+    "traces/trans.trace",
+    "traces/long.trace.old",
+]
+configs = [(5, 1, 5, "lru"), (2, 4, 3, "fifo"), (4, 2, 4, "random"), (3, 8, 4, "plru"), (1, 4, 1, "brrip")]
+
+
+class Config(ctypes.Structure):
+    _fields_ = [
+        ("s", ctypes.c_int),
+        ("E", ctypes.c_int),
+        ("b", ctypes.c_int),
+        ("policy", ctypes.c_char_p),
+        ("seed", ctypes.c_ulonglong),
+    ]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [
+        ("hits", ctypes.c_ulonglong),
+        ("misses", ctypes.c_ulonglong),
+        ("evictions", ctypes.c_ulonglong),
+        ("dirty_evictions", ctypes.c_ulonglong),
+        ("dirty_lines", ctypes.c_ulonglong),
+    ]
+
+
+class Ref(ctypes.Structure):
+    _fields_ = [("addr", ctypes.c_ulonglong), ("op", ctypes.c_char)]
+
+
+def load_library():
+    subprocess.run(["make", "-j"], check=True, capture_output=True)
+    lib = ctypes.CDLL("./libcachesim.so")
+    lib.cachesim_access.argtypes = [ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_int]
+    lib.cachesim_access_batch.restype = ctypes.c_ulonglong
+    lib.cachesim_access_batch.argtypes = [ctypes.c_void_p, ctypes.POINTER(Ref), ctypes.c_size_t, ctypes.c_char_p]
+    lib.cachesim_destroy.argtypes = [ctypes.c_void_p]
+    lib.cachesim_get_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(Stats)]
+    return lib
+
+
+def read_refs(trace_file):
+    refs = []
+    for line in open(trace_file):
+        fields = line.split()
+        if fields and fields[0] in ("L", "S", "M"):
+            refs.append(Ref(int(fields[1].split(",")[0], 16), fields[0].encode()))
+    return (Ref * len(refs))(*refs)
+
+
+def simulate(lib, config, refs, batch):
+    cache = ctypes.c_void_p()
+    assert lib.cachesim_create(ctypes.byref(cache), ctypes.byref(config)) == 0
+    if batch:
+        lib.cachesim_access_batch(cache, refs, len(refs), None)
+    else:
+        for ref in refs:
+            for _ in range(2 if ref.op == b"M" else 1):
+                lib.cachesim_access(cache, ref.addr, ref.op != b"L")
+    stats = Stats()
+    lib.cachesim_get_stats(cache, ctypes.byref(stats))
+    lib.cachesim_destroy(cache)
+    return stats.hits, stats.misses, stats.evictions
+
+
+def test_library():
+    lib = load_library()
+    results = []
+    for trace_file in trace_files:
+        refs = read_refs(trace_file)
+        for s, E, b, policy in configs:
+            config = Config(s, E, b, policy.encode(), 1)
+            batch = simulate(lib, config, refs, True)
+            single = simulate(lib, config, refs, False)
+            # a plain csim run goes through the library; -c still drives cache.h itself
+            runs = []
+            for args in (f"-s {s} -E {E} -b {b} -p {policy}", f"-c {s},{E},{b},{policy}"):
+                subprocess.call(["rm", "-f", ".csim_results"])
+                subprocess.run(f"./csim {args} -t {trace_file}", check=True, shell=True, capture_output=True)
+                runs.append(parse_results_file(open(".csim_results", "r").read()))
+            plain, csim = runs
+            ok = batch == single == plain == csim
+            results.append(("OK " if ok else "ERROR", trace_file, (s, E, b, policy), csim, batch))
+    results.insert(0, ["status", "trace_file", "config", "csim", "library"])
+    print(format_table(results))
+    assert all(row[0] == "OK " for row in results[1:])
+
+
+def test_invalid_config():
+    lib = load_library()
+    lib.cachesim_strerror.restype = ctypes.c_char_p
+    cache = ctypes.c_void_p()
+    cases = [
+        (Config(4, 3, 4, b"plru", 1), -4, b"plru needs a power-of-two E"),
+        (Config(4, 1, 4, b"mru", 1), -3, b"unknown replacement policy"),
+        (Config(-1, 1, 4, None, 1), -2, b"s, E or b out of range"),
+        (Config(60, 3, 10, b"lru", 1), -2, b"s, E or b out of range"),
+    ]
+    for config, err, message in cases:
+        assert lib.cachesim_create(ctypes.byref(cache), ctypes.byref(config)) == err
+        assert not cache.value
+        assert lib.cachesim_strerror(err) == message
+    # csim reports the library's reason, not a guess
+    proc = subprocess.run("./csim -p lru -s 60 -E 3 -b 10 -t traces/yi.trace", shell=True, capture_output=True, text=True)
+    assert proc.returncode == 1 and "out of range" in proc.stderr
+    print("invalid configurations rejected")
+
+
+if __name__ == "__main__":
+    test_library()
+    test_invalid_config()
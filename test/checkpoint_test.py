@@ -0,0 +1,39 @@
+import subprocess
+import tempfile
+from utils import *
+
+
+def test_checkpoint(trace_file="traces/long.trace.old"):
+    build()
+    policies = ["lru", "fifo", "random", "lfu", "bitplru", "plru", "srrip", "brrip"]
+    config_arg = " ".join(f"{s},{E},{b},{p}" for p in policies for s, E, b in configs if E & (E - 1) == 0)
+
+    def run(extra):
+        return csim_output(f"{extra} -w -t {trace_file}")
+
+    full = run(f"-c '{config_arg}'")
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        ckpt = f"{tmp}/csim_test.ckpt"
+        for records in (1, 100, 100000):
+            run(f"-c '{config_arg}' -C {ckpt}:{records}")
+            resumed = run(f"-R {ckpt}")
+            # a continuation that checkpoints again and branches from there twice
+            run(f"-R {ckpt} -C {ckpt}.fork:{records}")
+            forks = [run(f"-R {ckpt}.fork") for _ in range(2)]
+            ok = resumed == full and forks == [full, full]
+            results.append(("OK " if ok else "ERROR", records))
+
+        # a checkpoint must not resume on another trace, or on this one changed near its start
+        data = open(trace_file, "rb").read()
+        with open(f"{tmp}/changed.trace", "wb") as f:
+            f.write(data[:3] + (b"1" if data[3:4] != b"1" else b"2") + data[4:])
+        for other in ("traces/yi.trace", f"{tmp}/changed.trace"):
+            proc = subprocess.run(f"./csim -R {ckpt} -t {other}", shell=True, capture_output=True, text=True)
+            ok = proc.returncode == 1 and "does not fit" in proc.stderr
+            results.append(("OK " if ok else "ERROR", other))
+    check_table(["status", "split after"], results)
+
+
+if __name__ == "__main__":
+    test_checkpoint()
@@ -0,0 +1,44 @@
+import tempfile
+from utils import *
+
+
+def test_miss_classification():
+    build()
+    # fully associative twins of configs never have conflict misses
+    all_configs = configs + [(0, E << s, b) for s, E, b in configs]
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in all_configs)
+    results = []
+    for trace_file in trace_files:
+        lines = csim_output(f"-3 -c '{config_arg}' -t {trace_file}").splitlines()
+        n = len(all_configs)
+        for (s, E, b), summary, classes in zip(all_configs, lines[:n], lines[n:]):
+            misses = int(summary.split()[4].split(":")[1])
+            counts = [int(f.split(":")[1]) for f in classes.split()[3:]]
+            ok = sum(counts) == misses and (s != 0 or counts[2] == 0)
+            results.append(("OK " if ok else "ERROR", trace_file, s, E, b))
+    check_table(["status", "trace_file", "s", "E", "b"], results)
+
+
+def test_miss_classes():
+    build()
+    cases = {
+        # blocks 0 and 4 share set 0 of a direct-mapped cache with room for both
+        "ping-pong": ("-s 1 -E 1 -b 4", [0x0, 0x40] * 3, (2, 0, 4)),
+        # six blocks swept three times through four lines, three per set
+        "sweep": ("-s 1 -E 2 -b 4", [block << 4 for block in range(6)] * 3, (6, 12, 0)),
+    }
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, (geometry, addrs, expected) in cases.items():
+            trace_file = f"{tmp}/{name}.trace"
+            with open(trace_file, "w") as f:
+                f.writelines(f" L {addr:x},1\n" for addr in addrs)
+            line = csim_output(f"-3 {geometry} -t {trace_file}").splitlines()[1]
+            got = tuple(int(f.split(":")[1]) for f in line.split()[3:])
+            results.append(("OK " if got == expected else "ERROR", name, got, expected))
+    check_table(["status", "case", "compulsory, capacity, conflict", "expected"], results)
+
+
+if __name__ == "__main__":
+    test_miss_classification()
+    test_miss_classes()
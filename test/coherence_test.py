@@ -0,0 +1,67 @@
+import subprocess
+import tempfile
+from utils import *
+
+
+def coherence_run(args):
+    "Runs csim -X and returns (summary, per-core dicts, totals dict)."
+    lines = csim_output(args).splitlines()
+    fields = lambda line: {k: v for k, v in (kv.split(":", 1) for kv in line.split())}
+    cores = [fields(line) for line in lines if line.startswith("core:")]
+    totals = fields(next(line for line in lines if line.startswith("protocol:")))
+    return parse_csim_output(lines[0]), cores, totals
+
+
+def test_coherence(geometry="-s 4 -E 2 -b 6"):
+    build("csim", "tracegen")
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        # two cores storing to different words of one block, then to the same word
+        for name, addrs, false_sharing in (("false", (0x30000000, 0x30000004), True), ("true", (0x30000000,) * 2, False)):
+            for core, addr in enumerate(addrs):
+                with open(f"{tmp}/{name}{core}.trace", "w") as f:
+                    f.write(f" S {addr:x},4\n" * 100)
+            summary, cores, totals = coherence_run(f"-X mesi {geometry} -t {tmp}/{name}0.trace -t {tmp}/{name}1.trace")
+            ok = summary == (0, 200, 0) and totals["coherence_misses"] == "198"
+            ok = ok and totals["false_sharing"] == ("198" if false_sharing else "0")
+            results.append(("OK " if ok else "ERROR", f"{name} sharing", summary, totals["false_sharing"]))
+
+        # a writer and a reader: MESI writes the block back on every read, MOESI keeps it owned
+        with open(f"{tmp}/rw.trace", "w") as f:
+            f.write(" 0 S 30000000,4\n 1 L 30000000,4\n" * 50)
+        for protocol, writebacks in (("mesi", "50"), ("moesi", "0")):
+            summary, cores, totals = coherence_run(f"-X {protocol} {geometry} -t {tmp}/rw.trace")
+            ok = totals["writebacks"] == writebacks and totals["invalidations"] == "49" and len(cores) == 2
+            results.append(("OK " if ok else "ERROR", protocol, summary, totals["writebacks"]))
+
+        # blocks 0 and 2^58 with b = 0: both lost copies must be told apart
+        with open(f"{tmp}/high.trace", "w") as f:
+            f.write(" 0 L 0,1\n 1 S 0,1\n 0 S 400000000000000,1\n 1 S 400000000000000,1\n")
+            f.write(" 0 L 400000000000000,1\n 0 L 0,1\n")
+        summary, cores, totals = coherence_run(f"-X mesi -s 0 -E 4 -b 0 -t {tmp}/high.trace")
+        ok = cores[0]["coherence_misses"] == "2" and totals["invalidations"] == "2"
+        results.append(("OK " if ok else "ERROR", "high blocks", summary, cores[0]["coherence_misses"]))
+
+        # one trace per core, round-robin, equals one trace with core ids in that order
+        per_core = []
+        for core in range(3):
+            trace_file = f"{tmp}/random{core}.trace"
+            subprocess.run(f"./tracegen -x {core + 1} -n 20000 -r 0.3 -w 16k random {trace_file}", check=True, shell=True)
+            per_core.append(open(trace_file).read().splitlines())
+        with open(f"{tmp}/random.trace", "w") as f:
+            for records in zip(*per_core):
+                for core, record in enumerate(records):
+                    f.write(f" {core}{record}\n")
+        for protocol in ("mesi", "moesi"):
+            files = " ".join(f"-t {tmp}/random{core}.trace" for core in range(3))
+            split = coherence_run(f"-X {protocol} {geometry} {files}")
+            combined = coherence_run(f"-X {protocol} {geometry} -t {tmp}/random.trace")
+            hits = sum(int(core["hits"]) for core in split[1])
+            ok = split == combined and hits == split[0][0] and int(split[2]["false_sharing"]) > 0
+            results.append(("OK " if ok else "ERROR", f"{protocol} split", split[0], combined[0]))
+
+    check_table(["status", "case", "summary", "detail"], results)
+
+
+if __name__ == "__main__":
+    test_coherence()
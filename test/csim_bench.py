@@ -0,0 +1,103 @@
+"""Throughput benchmark for csim.
+
+Generates synthetic traces with tracegen, runs csim on each of them under
+several geometries and reports accesses per second, ns per access and the
+peak resident set size of every run. Run it with `make bench`, or directly
+for options (--accesses, --repeat, --json).
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import time
+from utils import *
+
+bench_dir = "workspaces/bench"
+
+# name -> tracegen arguments; {n} is the number of accesses of the stream patterns
+patterns = {
+    "seq": "-n {n} -w 64M seq",
+    "stride": "-n {n} -w 64M -k 4160 stride",
+    "random": "-n {n} -w 16M random",
+    "zipf": "-n {n} -w 64M -a 0.9 zipf",
+    "transpose": "transpose:1024",
+    "gemm": "gemm:96,96,96",
+}
+
+geometries = [
+    (5, 1, 5, "lru"),
+    (6, 8, 6, "lru"),
+    (10, 16, 6, "lru"),
+    (10, 16, 6, "srrip"),
+    (0, 256, 6, "lru"),
+]
+
+
+def run_once(args):
+    "Runs csim and returns (stdout, seconds, peak RSS in MiB)."
+    # the RSS comes from csim's -g summary: getrusage() of a child would
+    # include the peak of this interpreter, which it inherits through exec
+    start = time.perf_counter()
+    proc = subprocess.run(args + ["-g"], check=True, capture_output=True, text=True)
+    seconds = time.perf_counter() - start
+    rss = float(re.search(r"peak RSS ([0-9.]+) MiB", proc.stderr).group(1))
+    return proc.stdout, seconds, rss
+
+
+def bench(accesses, repeat):
+    subprocess.run(["make", "-j", "csim", "tracegen"], check=True, capture_output=True)
+    os.makedirs(bench_dir, exist_ok=True)
+    rows = []
+    for name, spec in patterns.items():
+        trace_file = f"{bench_dir}/{name}.bin"
+        subprocess.run(f"./tracegen -b {spec.format(n=accesses)} {trace_file}", check=True, shell=True)
+        for s, E, b, policy in geometries:
+            args = ["./csim", "-s", str(s), "-E", str(E), "-b", str(b), "-p", policy, "-t", trace_file]
+            runs = [run_once(args) for _ in range(repeat)]
+            out, seconds, rss = min(runs, key=lambda run: run[1])
+            hits, misses, _ = parse_csim_output(out)
+            n = hits + misses
+            rows.append(
+                {
+                    "trace": name,
+                    "config": f"{s},{E},{b},{policy}",
+                    "accesses": n,
+                    "seconds": seconds,
+                    "maccesses_per_s": n / seconds / 1e6,
+                    "ns_per_access": seconds * 1e9 / n,
+                    "peak_rss_mib": max(run[2] for run in runs),
+                    "miss_ratio": misses / n,
+                }
+            )
+    return rows
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--accesses", type=int, default=2000000, help="accesses of the stream patterns")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per case; the fastest one counts")
+    parser.add_argument("--json", help="also write the rows to this file")
+    options = parser.parse_args()
+
+    rows = bench(options.accesses, options.repeat)
+    table = [["trace", "config", "accesses", "M acc/s", "ns/access", "peak RSS MiB", "miss ratio"]]
+    for row in rows:
+        table.append(
+            [
+                row["trace"],
+                row["config"],
+                row["accesses"],
+                f"{row['maccesses_per_s']:.2f}",
+                f"{row['ns_per_access']:.1f}",
+                f"{row['peak_rss_mib']:.1f}",
+                f"{row['miss_ratio']:.4f}",
+            ]
+        )
+    print(format_table(table))
+    total = sum(row["accesses"] for row in rows) / sum(row["seconds"] for row in rows)
+    print(f"overall: {total / 1e6:.2f} M accesses/s")
+    if options.json:
+        with open(options.json, "w") as f:
+            json.dump(rows, f, indent=2)
@@ -0,0 +1,44 @@
+from utils import *
+
+
+def test_csim_multi():
+    build()
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in configs)
+    results = []
+    for trace_file in trace_files:
+        multi_results = csim_results(f"-c '{config_arg}' -t {trace_file}")
+        for (s, E, b), multi_result in zip(configs, multi_results):
+            (single_result,) = csim_results(f"-s {s} -E {E} -b {b} -t {trace_file}")
+            status = "OK " if single_result == multi_result else "ERROR"
+            results.append((status, trace_file, (s, E, b), single_result, multi_result))
+    check_table(["status", "trace_file", "(s, E, b)", "single", "multi"], results)
+
+
+def test_miss_ratio_curve(s=2, b=3, max_E=8):
+    build()
+    config_arg = " ".join(f"{s},{E},{b}" for E in range(1, max_E + 1))
+    results = []
+    for trace_file in trace_files:
+        output = csim_output(f"-s {s} -E 1 -b {b} -m {max_E} -t {trace_file}")
+        curve = [tuple(map(int, line.split()[1:4])) for line in output.strip().split("\n")[-max_E:]]
+        multi_results = csim_results(f"-c '{config_arg}' -t {trace_file}")
+        status = "OK " if curve == multi_results else "ERROR"
+        results.append((status, trace_file, (s, b, max_E)))
+    check_table(["status", "trace_file", "(s, b, max E)"], results)
+
+
+def test_csim_threads(threads=4):
+    build()
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in configs)
+    results = []
+    for trace_file in trace_files:
+        outputs = [csim_results(f"-c '{config_arg}' -j {j} -t {trace_file}") for j in (1, threads)]
+        status = "OK " if outputs[0] == outputs[1] else "ERROR"
+        results.append((status, trace_file, threads))
+    check_table(["status", "trace_file", "threads"], results)
+
+
+if __name__ == "__main__":
+    test_csim_multi()
+    test_miss_ratio_curve()
+    test_csim_threads()
@@ -0,0 +1,25 @@
+import struct
+import tempfile
+from utils import *
+
+
+def test_event_log():
+    build()
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in configs)
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        log_file = f"{tmp}/events.bin"
+        for trace_file in trace_files:
+            expected = csim_results(f"-c '{config_arg}' -e {log_file} -t {trace_file}")
+            data = open(log_file, "rb").read()
+            counts = [[0, 0, 0] for _ in configs]
+            for _, _, result, _, index in struct.iter_unpack("<QQBc2xI", data[8:]):
+                counts[index][0 if result == 0 else 1] += 1
+                counts[index][2] += result >> 1
+            ok = data[:5] == b"\x89CLE\x02" and [tuple(c) for c in counts] == expected
+            results.append(("OK " if ok else "ERROR", trace_file))
+    check_table(["status", "trace_file"], results)
+
+
+if __name__ == "__main__":
+    test_event_log()
@@ -0,0 +1,27 @@
+import tempfile
+from utils import *
+
+
+def test_prefetch(case="case2"):
+    build()
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in configs)
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        trace_file = gemm_trace(case, tmp)
+        for spec in ("next", "next,2", "stride", "stride,4", "stream", "stream,2,8"):
+            lines = csim_output(f"-c '{config_arg}' -f {spec} -t {trace_file}").splitlines()
+            ok = True
+            for summary, line in zip(lines[: len(configs)], lines[len(configs) :]):
+                hits = int(summary.split()[3].split(":")[1])
+                fields = dict(f.split(":") for f in line.split())
+                issued, used, useless = (
+                    int(fields[k]) for k in ("prefetches", "prefetch_hits", "useless_prefetches")
+                )
+                # every prefetch is either used before it leaves or counted useless
+                ok &= issued == used + useless and used <= hits
+            results.append(("OK " if ok else "ERROR", case, spec))
+    check_table(["status", "case", "prefetcher"], results)
+
+
+if __name__ == "__main__":
+    test_prefetch()
@@ -0,0 +1,59 @@
+import tempfile
+from utils import *
+
+
+def reuse_model(trace_file, b, bounds):
+    "Brute-force log2 reuse distance buckets, per region index of bounds and overall."
+    stack = []
+    hist = {}
+    for line in open(trace_file):
+        fields = line.split()
+        if not fields or fields[0] not in ("L", "S", "M"):
+            continue
+        addr = int(fields[1].split(",")[0], 16)
+        region = next((r for r, end in enumerate(bounds) if 0x30000000 <= addr < end), len(bounds))
+        block = addr >> b
+        for _ in range(2 if fields[0] == "M" else 1):
+            if block in stack:
+                d = len(stack) - 1 - stack.index(block)
+                stack.remove(block)
+                bucket = str(d) if d < 2 else f"{1 << (d.bit_length() - 1)}-{(1 << d.bit_length()) - 1}"
+            else:
+                bucket = "cold"
+            stack.append(block)
+            for key in ((bucket, "all"), (bucket, region)):
+                hist[key] = hist.get(key, 0) + 1
+    return hist
+
+
+def test_reuse_distance(case="case2", sizes=(32, 32, 32)):
+    build()
+    m, n, p = sizes
+    ends = [0x30000000 + 4 * m * n, 0x30000000 + 4 * (m * n + n * p), 0x30000000 + 4 * (m * n + n * p + m * p)]
+    ends.append(ends[2] + 4 * 64)
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        cases = [(gemm_trace(case, tmp), 5, 1, 5), ("traces/yi.trace", 4, 2, 4), ("traces/trans.trace", 2, 1, 3)]
+        for trace_file, s, E, b in cases:
+            lines = csim_output(f"-s {s} -E {E} -b {b} -D -a {m},{n},{p} -t {trace_file}").splitlines()
+            start = lines.index(f"reuse distance (b={b}):")
+            header = lines[start + 1].split()
+            shown = [["A", "B", "C", "buffer", "other"].index(column) for column in header[3:]]
+            got = {}
+            for line in lines[start + 2 :]:
+                fields = line.split()
+                got[(fields[0], "all")] = int(fields[1])
+                for region, value in zip(shown, fields[3:]):
+                    got[(fields[0], region)] = int(value)
+            got = {key: value for key, value in got.items() if value}
+            model = reuse_model(trace_file, b, ends)
+            # "other" is only shown when something falls outside the matrices
+            ok = got == {key: value for key, value in model.items() if key[1] == "all" or key[1] in shown}
+            ok = ok and (4 in shown) == any(key[1] == 4 for key in model)
+            ok = ok and float(lines[-1].split()[2]) == 1.0
+            results.append(("OK " if ok else "ERROR", case if trace_file.startswith(tmp) else trace_file, s, E, b))
+    check_table(["status", "trace_file", "s", "E", "b"], results)
+
+
+if __name__ == "__main__":
+    test_reuse_distance()
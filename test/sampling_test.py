@@ -0,0 +1,59 @@
+import subprocess
+import tempfile
+import time
+from utils import *
+
+
+def test_set_sampling(trace_file="traces/long.trace.old"):
+    build()
+    # the skewed trace needs the configurations with many sets
+    sampled_configs = [(s, E, b) for s, E, b in configs if s >= 4] + [(10, 2, 4), (8, 4, 5)]
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in sampled_configs)
+    n = len(sampled_configs)
+
+    def run(extra):
+        return csim_output(f"-c '{config_arg}' {extra} -t {trace_file}").splitlines()
+
+    full = run("")
+    results = []
+    for fraction, seeds in ((1, [1]), (0.5, [1]), (0.1, range(1, 9)), (0.05, range(1, 9))):
+        for seed in seeds:
+            lines = run(f"-S {fraction} -r {seed}")
+            for exact, line in zip(full, lines[n:]):
+                misses = int(exact.split()[4].split(":")[1])
+                lo, hi = (int(x) for x in line.split("misses_95ci:[")[1].split("]")[0].split(", "))
+                ok = lo <= misses <= hi and (fraction < 1 or lines[:n] == full)
+                results.append(("OK " if ok else "MISS", fraction, seed, exact.split()[:3], misses, (lo, hi)))
+    print(format_table([["status", "fraction", "seed", "config", "misses", "95% interval"]] + results))
+    # a 95% interval may miss now and then, but not often and never at the larger fractions
+    assert all(row[0] == "OK " for row in results if row[1] >= 0.5)
+    covered = sum(row[0] == "OK " for row in results) / len(results)
+    print(f"coverage: {covered:.1%}")
+    assert covered >= 0.9
+
+
+def test_sampling_speed(geometry="-s 10 -E 8 -b 6", repeat=3):
+    build("csim", "tracegen")
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        trace_file = f"{tmp}/random.trace"
+        subprocess.run(f"./tracegen -n 2000000 -w 64M random {trace_file}", check=True, shell=True)
+
+        def seconds(extra):
+            runs = []
+            for _ in range(repeat):
+                start = time.perf_counter()
+                csim_output(f"{geometry} {extra} -t {trace_file}")
+                runs.append(time.perf_counter() - start)
+            return min(runs)
+
+        full = seconds("")
+        for fraction in (0.1, 0.01):
+            sampled = seconds(f"-S {fraction}")
+            results.append(("OK " if sampled < full else "ERROR", fraction, f"{full:.3f}s", f"{sampled:.3f}s"))
+    check_table(["status", "fraction", "full", "sampled"], results)
+
+
+if __name__ == "__main__":
+    test_set_sampling()
+    test_sampling_speed()
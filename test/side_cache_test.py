@@ -0,0 +1,46 @@
+from collections import OrderedDict
+from utils import *
+
+
+def side_cache_model(trace_file, s, b, entries, victim):
+    """Direct-mapped cache with a victim (or miss) cache; returns the absorbed misses."""
+    lines, buf, absorbed = {}, OrderedDict(), 0
+    for line in open(trace_file):
+        fields = line.split()
+        if not fields or fields[0] == "I":
+            continue
+        block = int(fields[1].split(",")[0], 16) >> b
+        for _ in range(2 if fields[0] == "M" else 1):
+            index = block & ((1 << s) - 1)
+            if lines.get(index) == block:
+                continue
+            old, lines[index] = lines.get(index), block
+            if block in buf:
+                absorbed += 1
+                if victim:
+                    del buf[block]
+                else:
+                    buf.move_to_end(block)
+                    continue
+            insert = old if victim else block
+            if insert is not None:
+                buf[insert] = True
+                buf.move_to_end(insert)
+                if len(buf) > entries:
+                    buf.popitem(last=False)
+    return absorbed
+
+
+def test_side_caches(s=5, b=4, entries=4):
+    build()
+    results = []
+    for trace_file in trace_files:
+        lines = csim_output(f"-s {s} -E 1 -b {b} -V {entries} -M {entries} -t {trace_file}").splitlines()
+        got = [int(line.split()[4].split(":")[1]) for line in lines[1:3]]
+        expected = [side_cache_model(trace_file, s, b, entries, victim) for victim in (True, False)]
+        results.append(("OK " if got == expected else "ERROR", trace_file, got, expected))
+    check_table(["status", "trace_file", "absorbed", "expected"], results)
+
+
+if __name__ == "__main__":
+    test_side_caches()
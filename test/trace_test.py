@@ -0,0 +1,95 @@
+import subprocess
+import tempfile
+from utils import *
+
+
+def run_csim(args, trace_file, pipe=False):
+    subprocess.call(["rm", "-f", ".csim_results"])
+    subprocess.run(
+        f"cat {trace_file} | ./csim {args} -t -" if pipe else f"./csim {args} -t {trace_file}",
+        check=True,
+        shell=True,
+        capture_output=True,
+    )
+    return parse_results_file(open(".csim_results", "r").read())
+
+
+def test_binary_trace():
+    trace_files = [
+        "traces/yi2.trace",
+        "traces/yi.trace",
+        "traces/dave.trace",
+        "traces/trans.trace",
+        "traces/long.trace.old",
+    ]
+    subprocess.run(["make", "-j"], check=True, shell=True, capture_output=True)
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for trace_file in trace_files:
+            bin_file = f"{tmp}/trace_test.bin"
+            txt_file = f"{tmp}/trace_test.txt"
+            subprocess.run(["./traceconv", trace_file, bin_file], check=True)
+            subprocess.run(["./traceconv", bin_file, txt_file], check=True)
+            text_results = run_csim("-s 4 -E 2 -b 4", trace_file)
+            bin_results = run_csim("-s 4 -E 2 -b 4", bin_file)
+            round_results = run_csim("-s 4 -E 2 -b 4", txt_file)
+            ok = text_results == bin_results == round_results
+            results.append(("OK " if ok else "ERROR", trace_file, text_results, bin_results))
+    results.insert(0, ["status", "trace_file", "text", "binary"])
+    print(format_table(results))
+    assert all(row[0] == "OK " for row in results[1:])
+
+
+def test_streaming_trace():
+    trace_files = [
+        "traces/yi.trace",
+        "traces/trans.trace",
+        "traces/long.trace.old",
+    ]
+    subprocess.run(["make", "-j"], check=True, shell=True, capture_output=True)
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for trace_file in trace_files:
+            bin_file = f"{tmp}/trace_test.bin"
+            subprocess.run(["./traceconv", "-b", trace_file, bin_file], check=True)
+            file_results = run_csim("-s 4 -E 2 -b 4", trace_file)
+            text_results = run_csim("-s 4 -E 2 -b 4", trace_file, pipe=True)
+            bin_results = run_csim("-s 4 -E 2 -b 4", bin_file, pipe=True)
+            ok = file_results == text_results == bin_results
+            results.append(("OK " if ok else "ERROR", trace_file, file_results, text_results, bin_results))
+    results.insert(0, ["status", "trace_file", "file", "text pipe", "binary pipe"])
+    print(format_table(results))
+    assert all(row[0] == "OK " for row in results[1:])
+
+
+def test_tracegen():
+    subprocess.run(["make", "-j"], check=True, shell=True, capture_output=True)
+    # pattern -> accesses it should produce
+    patterns = {
+        "-n 5000 -w 64k seq": 5000,
+        "-n 5000 -w 64k -k 4160 stride": 5000,
+        "-n 5000 -w 64k -r 0.5 random": 5000,
+        "-n 5000 -w 64k -a 0.8 zipf": 5000,
+        "transpose:24": 2 * 24 * 24,
+        "gemm:5,7,9": 5 * 9 * (2 * 7 + 2),
+    }
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for spec, expected in patterns.items():
+            txt_file = f"{tmp}/tracegen_test.txt"
+            bin_file = f"{tmp}/tracegen_test.bin"
+            subprocess.run(f"./tracegen {spec} {txt_file}", check=True, shell=True)
+            subprocess.run(f"./tracegen -b {spec} {bin_file}", check=True, shell=True)
+            text_results = run_csim("-s 4 -E 2 -b 4", txt_file)
+            bin_results = run_csim("-s 4 -E 2 -b 4", bin_file)
+            ok = text_results == bin_results and text_results[0] + text_results[1] == expected
+            results.append(("OK " if ok else "ERROR", spec, expected, text_results, bin_results))
+    results.insert(0, ["status", "pattern", "accesses", "text", "binary"])
+    print(format_table(results))
+    assert all(row[0] == "OK " for row in results[1:])
+
+
+if __name__ == "__main__":
+    test_binary_trace()
+    test_streaming_trace()
+    test_tracegen()
@@ -1,5 +1,16 @@
 import datetime
 import os
+import subprocess
+
+# the traces and (s, E, b) configurations the csim feature tests share
+trace_files = [
+    "traces/yi2.trace",
+    "traces/yi.trace",
+    "traces/dave.trace",
+    "traces/trans.trace",
+    "traces/long.trace.old",
+]
+configs = [(5, 1, 5), (2, 4, 3), (4, 2, 4), (1, 1, 1)]
 
 
 def parse_csim_output(text) -> tuple:
@@ -35,6 +46,35 @@ def format_table(data):
     return table_str
 
 
+def build(*targets):
+    subprocess.run(["make", "-j", *targets], check=True, capture_output=True)
+
+
+def csim_output(args) -> str:
+    "stdout of ./csim args, which must succeed"
+    return subprocess.run(f"./csim {args}", check=True, shell=True, capture_output=True, text=True).stdout
+
+
+def csim_results(args) -> list:
+    "the .csim_results rows of ./csim args, one tuple per configuration"
+    subprocess.call(["rm", "-f", ".csim_results"])
+    csim_output(args)
+    return [parse_results_file(line) for line in open(".csim_results", "r").read().strip().split("\n")]
+
+
+def gemm_trace(case, directory) -> str:
+    "writes the trace of a printTrace case into directory and returns its path"
+    trace_file = os.path.join(directory, f"{case}.trace")
+    subprocess.run(f"./printTrace {case} > {trace_file}", check=True, shell=True, capture_output=True)
+    return trace_file
+
+
+def check_table(header, results):
+    "prints results under header and fails unless every row's status is OK"
+    print(format_table([header] + results))
+    assert all(row[0] == "OK " for row in results)
+
+
 def write_current_time(filename):
     with open(filename, "w") as file:
         file.write(datetime.datetime.now().isoformat())
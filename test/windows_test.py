@@ -0,0 +1,59 @@
+import tempfile
+from utils import *
+
+
+def test_windows(window=1000):
+    build()
+    config_arg = " ".join(f"{s},{E},{b}" for s, E, b in configs)
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        csv_file = f"{tmp}/windows.csv"
+        for trace_file in trace_files:
+            expected = csim_results(f"-c '{config_arg}' -T {window},ws -o {csv_file} -t {trace_file}")
+            sums = [[0, 0, 0] for _ in configs]
+            ok = True
+            rows = open(csv_file).read().splitlines()[1:]
+            for k, row in enumerate(rows):
+                fields = row.split(",")
+                hits, misses, evictions = map(int, fields[5:8])
+                sums[k % len(configs)] = [x + y for x, y in zip(sums[k % len(configs)], (hits, misses, evictions))]
+                ok &= int(fields[-1]) <= hits + misses <= window
+            ok &= [tuple(c) for c in sums] == expected
+            results.append(("OK " if ok else "ERROR", trace_file, len(rows)))
+    check_table(["status", "trace_file", "rows"], results)
+
+
+def test_window_rows():
+    build()
+    # blocks 0-8 of 16 bytes, four accesses (M is two) per window; the
+    # set-associative cache splits the blocks by parity
+    records = ["L 0", "L 10", "L 0", "L 10", "L 20", "L 30", "L 40", "L 50"]
+    records += ["L 0", "L 0", "L 0", "L 0", "L 60", "L 70", "M 80", "L 0"]
+    expected = [
+        "window,first_access,s,E,b,hits,misses,evictions,miss_rate,working_set",
+        "0,0,1,2,4,2,2,0,0.500000,2",
+        "0,0,0,1,4,0,4,3,1.000000,2",
+        "1,4,1,2,4,0,4,2,1.000000,4",
+        "1,4,0,1,4,0,4,4,1.000000,4",
+        "2,8,1,2,4,3,1,1,0.250000,1",
+        "2,8,0,1,4,3,1,1,0.250000,1",
+        "3,12,1,2,4,1,3,3,0.750000,3",
+        "3,12,0,1,4,1,3,3,0.750000,3",
+        # the last window is cut short by the end of the trace
+        "4,16,1,2,4,0,1,1,1.000000,1",
+        "4,16,0,1,4,0,1,1,1.000000,1",
+    ]
+    with tempfile.TemporaryDirectory() as tmp:
+        trace_file, csv_file = f"{tmp}/windows.trace", f"{tmp}/windows.csv"
+        with open(trace_file, "w") as f:
+            f.writelines(f" {record},1\n" for record in records)
+        csim_output(f"-c '1,2,4 0,1,4' -T 4,ws -o {csv_file} -t {trace_file}")
+        rows = open(csv_file).read().splitlines()
+    results = [("OK " if got == want else "ERROR", got, want) for got, want in zip(rows, expected)]
+    assert len(rows) == len(expected)
+    check_table(["status", "row", "expected"], results)
+
+
+if __name__ == "__main__":
+    test_windows()
+    test_window_rows()
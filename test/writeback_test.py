@@ -0,0 +1,21 @@
+from utils import *
+
+
+def test_write_back_traffic():
+    build()
+    results = []
+    for trace_file in trace_files:
+        for s, E, b in configs:
+            single = csim_output(f"-w -s {s} -E {E} -b {b} -t {trace_file}").split("\n")[1]
+            fields = dict(f.split(":") for f in single.split()[3:])
+            # a one-level hierarchy flushes the dirty lines left at the end
+            hier = csim_output(f"-w -H '{s},{E},{b}' -t {trace_file}").split("\n")[2]
+            writebacks = int(hier.split()[0].split(":")[1])
+            expected = int(fields["dirty_evictions"]) + int(fields["dirty_at_exit"])
+            ok = writebacks == expected and int(fields["bytes_written"]) == expected << b
+            results.append(("OK " if ok else "ERROR", trace_file, s, E, b))
+    check_table(["status", "trace_file", "s", "E", "b"], results)
+
+
+if __name__ == "__main__":
+    test_write_back_traffic()
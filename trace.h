@@ -0,0 +1,730 @@
+#pragma once
+/*
+ * Memory trace formats shared by printTrace, csim and traceconv.
+ *
+ * Text traces look like " L 30000000,4 8": op, hex address (optionally 0x
+ * prefixed), decimal size and the register id written by print_log(). The
+ * register id is optional so that plain valgrind traces still work. Traces
+ * of several cores may put "<core>", "@<time>" or "<core>@<time>" in front
+ * of the op, e.g. " 2@1500 S 30000040,4"; binary traces do not keep these.
+ *
+ * Binary traces start with an 8 byte header: "\x89CLT", a version byte and
+ * three reserved zero bytes. Every record that follows is one tag byte
+ *
+ *   bits 0-1  op:   0 L, 1 S, 2 M, 3 raw op byte follows
+ *   bits 2-4  size: 0..3 for 1/2/4/8 bytes, 4 varint size follows
+ *   bits 5-6  reg:  0 same as previous record, 1 immediate (-1),
+ *                   2 no register column, 3 zigzag varint follows
+ *
+ * followed by the optional fields in that order and the zigzag varint of
+ * the address delta to the previous record. Blank lines are not stored.
+ *
+ * The reader maps the file and decodes it in place. Text lines are never
+ * copied, except a final line that lacks its '\n', which is moved into a
+ * small side buffer so that the scanner can rely on every line being
+ * terminated.
+ *
+ * Pipes, and "-" for stdin, cannot be mapped. They are read through a fixed
+ * window instead, refilled whenever the scanner runs out of complete lines
+ * or records, so memory stays bounded however long the trace is.
+ *
+ * Everything here is header-only so that it can be used from C and C++.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TRACE_REG_NONE INT_MIN
+#define TRACE_TIME_NONE (~0ULL)
+#define TRACE_LINE_MAX 96 /* longest line trace_format_line() writes */
+#define TRACE_HEAD_LEN 4096 /* leading bytes trace_head() can return */
+#define TRACE_SIZE_UNKNOWN (~0ULL)
+
+#define TRACE_BIN_VERSION 1
+#define TRACE_BIN_HEADER_LEN 8
+#define TRACE_BIN_MAX_REC 24
+
+#ifndef TRACE_STREAM_WINDOW
+#define TRACE_STREAM_WINDOW (1 << 20)
+#endif
+
+static const unsigned char trace_bin_magic[4] = {0x89, 'C', 'L', 'T'};
+
+typedef struct
+{
+  char op; /* 0 for blank lines */
+  int size;
+  int reg; /* -1 for immediates, TRACE_REG_NONE when the column is missing */
+  unsigned long long addr;
+  int core;                /* leading core id, or -1 */
+  unsigned long long time; /* leading @time, or TRACE_TIME_NONE */
+} trace_rec_t;
+
+/* Delta state carried between consecutive binary records. */
+typedef struct
+{
+  unsigned long long prev_addr;
+  int prev_reg;
+} trace_codec_t;
+
+typedef struct
+{
+  const char *data;
+  size_t map_len;  /* 0 if data was not mmap'ed */
+  const char *cur; /* next unread byte */
+  const char *end; /* text: one past the last '\n'; binary: end of data */
+  char *tail;      /* unterminated last line plus '\n', or NULL */
+  size_t tail_len; /* without the added '\n' */
+  int tail_pending;
+  int binary;
+  trace_codec_t codec;
+  /* streaming input only */
+  int stream, fd, eof;
+  char *window;
+  size_t window_cap, window_len;
+  unsigned long long consumed; /* bytes dropped from the front of the window */
+  char head[TRACE_HEAD_LEN];   /* copy of the first bytes read */
+  size_t head_len;
+} trace_t;
+
+/* A resumable position: input bytes consumed and the binary delta state there. */
+typedef struct
+{
+  unsigned long long offset;
+  trace_codec_t codec;
+} trace_pos_t;
+
+/* ---------------------------------------------------------------- text --- */
+
+/* 0..15 for hex digits, 0x10 for blanks other than '\n', 0xff otherwise */
+#define TRACE_CH_BLANK 0x10
+#define TRACE_CH_OTHER 0xff
+
+static inline const unsigned char *trace_char_class(void)
+{
+  static unsigned char table[256];
+  static int ready = 0;
+  if (!ready)
+  {
+    memset(table, TRACE_CH_OTHER, sizeof(table));
+    for (int c = '0'; c <= '9'; ++c)
+      table[c] = c - '0';
+    for (int c = 'a'; c <= 'f'; ++c)
+      table[c] = c - 'a' + 10;
+    for (int c = 'A'; c <= 'F'; ++c)
+      table[c] = c - 'A' + 10;
+    table[' '] = table['\t'] = table['\r'] = TRACE_CH_BLANK;
+    table['\v'] = table['\f'] = TRACE_CH_BLANK;
+    ready = 1;
+  }
+  return table;
+}
+
+static inline const char *trace_skip_blanks(const unsigned char *cls, const char *p)
+{
+  while (cls[(unsigned char)*p] == TRACE_CH_BLANK)
+    ++p;
+  return p;
+}
+
+static inline const char *trace_parse_dec(const char *p, int *out)
+{
+  int neg = (*p == '-');
+  p += neg;
+  int v = 0;
+  unsigned d;
+  while ((d = (unsigned char)*p - '0') < 10)
+  {
+    v = v * 10 + (int)d;
+    ++p;
+  }
+  *out = neg ? -v : v;
+  return p;
+}
+
+/* Parses the "<core>@<time>" columns in front of the op, either of them optional. */
+static inline const char *trace_parse_prefix(const unsigned char *cls, const char *p, trace_rec_t *rec)
+{
+  if (*p != '@')
+    p = trace_parse_dec(p, &rec->core);
+  if (*p == '@')
+  {
+    unsigned long long time = 0;
+    unsigned d;
+    while ((d = (unsigned char)*++p - '0') < 10)
+      time = time * 10 + d;
+    rec->time = time;
+  }
+  return trace_skip_blanks(cls, p);
+}
+
+/* Parses one '\n'-terminated line starting at p, returns the start of the next. */
+static inline const char *trace_parse_line(const unsigned char *cls, const char *p, trace_rec_t *rec)
+{
+  p = trace_skip_blanks(cls, p);
+  rec->op = 0;
+  rec->core = -1;
+  rec->time = TRACE_TIME_NONE;
+  if (*p == '@' || (unsigned)((unsigned char)*p - '0') < 10)
+    p = trace_parse_prefix(cls, p, rec);
+  if (*p == '\n')
+    return p + 1;
+  rec->op = *p++;
+  p = trace_skip_blanks(cls, p);
+  if (p[0] == '0' && (p[1] | 0x20) == 'x')
+    p += 2;
+  unsigned long long addr = 0;
+  unsigned d;
+  while ((d = cls[(unsigned char)*p]) < 16)
+  {
+    addr = (addr << 4) | d;
+    ++p;
+  }
+  rec->addr = addr;
+  rec->size = 0;
+  rec->reg = TRACE_REG_NONE;
+  if (*p == ',')
+  {
+    p = trace_parse_dec(p + 1, &rec->size);
+    p = trace_skip_blanks(cls, p);
+    if (*p == '-' || (unsigned)((unsigned char)*p - '0') < 10)
+      p = trace_parse_dec(p, &rec->reg);
+  }
+  while (*p != '\n')
+    ++p;
+  return p + 1;
+}
+
+/* Formats rec as a print_log() style line; buf needs TRACE_LINE_MAX bytes. Returns the length. */
+static inline int trace_format_line(const trace_rec_t *rec, char *buf)
+{
+  static const char hex[] = "0123456789abcdef";
+  char tmp[20];
+  int n = 0, k = 0;
+  buf[n++] = ' ';
+  if (rec->core >= 0 || rec->time != TRACE_TIME_NONE)
+  {
+    unsigned long long v = (unsigned long long)rec->core;
+    if (rec->core >= 0)
+    {
+      do
+      {
+        tmp[k++] = (char)('0' + v % 10);
+        v /= 10;
+      } while (v);
+      while (k)
+        buf[n++] = tmp[--k];
+    }
+    if (rec->time != TRACE_TIME_NONE)
+    {
+      buf[n++] = '@';
+      v = rec->time;
+      do
+      {
+        tmp[k++] = (char)('0' + v % 10);
+        v /= 10;
+      } while (v);
+      while (k)
+        buf[n++] = tmp[--k];
+    }
+    buf[n++] = ' ';
+  }
+  buf[n++] = rec->op;
+  buf[n++] = ' ';
+  buf[n++] = '0';
+  buf[n++] = 'x';
+  unsigned long long a = rec->addr;
+  do
+  {
+    tmp[k++] = hex[a & 15];
+    a >>= 4;
+  } while (a);
+  while (k)
+    buf[n++] = tmp[--k];
+  buf[n++] = ',';
+  unsigned long long v = (unsigned long long)(rec->size < 0 ? -(long long)rec->size : rec->size);
+  if (rec->size < 0)
+    buf[n++] = '-';
+  do
+  {
+    tmp[k++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (k)
+    buf[n++] = tmp[--k];
+  if (rec->reg != TRACE_REG_NONE)
+  {
+    buf[n++] = ' ';
+    v = (unsigned long long)(rec->reg < 0 ? -(long long)rec->reg : rec->reg);
+    if (rec->reg < 0)
+      buf[n++] = '-';
+    do
+    {
+      tmp[k++] = (char)('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (k)
+      buf[n++] = tmp[--k];
+  }
+  buf[n++] = '\n';
+  return n;
+}
+
+/* -------------------------------------------------------------- binary --- */
+
+static inline void trace_bin_header(unsigned char *out)
+{
+  memcpy(out, trace_bin_magic, 4);
+  out[4] = TRACE_BIN_VERSION;
+  out[5] = out[6] = out[7] = 0;
+}
+
+static inline unsigned char *trace_put_varint(unsigned char *out, unsigned long long v)
+{
+  while (v >= 0x80)
+  {
+    *out++ = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  *out++ = (unsigned char)v;
+  return out;
+}
+
+static inline const unsigned char *trace_get_varint(const unsigned char *p, const unsigned char *end,
+                                                    unsigned long long *v)
+{
+  unsigned long long r = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7)
+  {
+    unsigned char c = *p++;
+    r |= (unsigned long long)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+    {
+      *v = r;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static inline unsigned long long trace_zigzag(long long v)
+{
+  return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static inline long long trace_unzigzag(unsigned long long v)
+{
+  return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+static inline void trace_codec_init(trace_codec_t *c)
+{
+  c->prev_addr = 0;
+  c->prev_reg = TRACE_REG_NONE;
+}
+
+/* Encodes rec into out (at least TRACE_BIN_MAX_REC bytes), returns the length. */
+static inline size_t trace_encode(trace_codec_t *c, const trace_rec_t *rec, unsigned char *out)
+{
+  unsigned char *p = out + 1;
+  unsigned tag;
+  switch (rec->op)
+  {
+  case 'L':
+    tag = 0;
+    break;
+  case 'S':
+    tag = 1;
+    break;
+  case 'M':
+    tag = 2;
+    break;
+  default:
+    tag = 3;
+    *p++ = (unsigned char)rec->op;
+    break;
+  }
+  switch (rec->size)
+  {
+  case 1:
+    break;
+  case 2:
+    tag |= 1 << 2;
+    break;
+  case 4:
+    tag |= 2 << 2;
+    break;
+  case 8:
+    tag |= 3 << 2;
+    break;
+  default:
+    tag |= 4 << 2;
+    p = trace_put_varint(p, trace_zigzag(rec->size));
+    break;
+  }
+  if (rec->reg == c->prev_reg)
+    ;
+  else if (rec->reg == -1)
+    tag |= 1 << 5;
+  else if (rec->reg == TRACE_REG_NONE)
+    tag |= 2 << 5;
+  else
+  {
+    tag |= 3 << 5;
+    p = trace_put_varint(p, trace_zigzag(rec->reg));
+  }
+  p = trace_put_varint(p, trace_zigzag((long long)(rec->addr - c->prev_addr)));
+  out[0] = (unsigned char)tag;
+  c->prev_addr = rec->addr;
+  c->prev_reg = rec->reg;
+  return (size_t)(p - out);
+}
+
+/* Decodes one record at p, returns the next record or NULL if truncated. */
+static inline const unsigned char *trace_decode(trace_codec_t *c, const unsigned char *p,
+                                                const unsigned char *end, trace_rec_t *rec)
+{
+  static const char ops[3] = {'L', 'S', 'M'};
+  unsigned long long v;
+  if (p >= end)
+    return NULL;
+  unsigned tag = *p++;
+  if ((tag & 3) != 3)
+    rec->op = ops[tag & 3];
+  else
+  {
+    if (p >= end)
+      return NULL;
+    rec->op = (char)*p++;
+  }
+  unsigned size_code = (tag >> 2) & 7;
+  if (size_code < 4)
+    rec->size = 1 << size_code;
+  else
+  {
+    if (!(p = trace_get_varint(p, end, &v)))
+      return NULL;
+    rec->size = (int)trace_unzigzag(v);
+  }
+  switch ((tag >> 5) & 3)
+  {
+  case 0:
+    rec->reg = c->prev_reg;
+    break;
+  case 1:
+    rec->reg = -1;
+    break;
+  case 2:
+    rec->reg = TRACE_REG_NONE;
+    break;
+  default:
+    if (!(p = trace_get_varint(p, end, &v)))
+      return NULL;
+    rec->reg = (int)trace_unzigzag(v);
+    break;
+  }
+  if (!(p = trace_get_varint(p, end, &v)))
+    return NULL;
+  rec->addr = c->prev_addr + (unsigned long long)trace_unzigzag(v);
+  rec->core = -1;
+  rec->time = TRACE_TIME_NONE;
+  c->prev_addr = rec->addr;
+  c->prev_reg = rec->reg;
+  return p;
+}
+
+/* -------------------------------------------------------------- reader --- */
+
+static inline int trace_is_binary(const void *data, size_t len)
+{
+  return len >= TRACE_BIN_HEADER_LEN && memcmp(data, trace_bin_magic, 4) == 0;
+}
+
+/* Moves a final line that lacks its '\n' from [t->end, end) into the side buffer. Returns 0 or -1. */
+static inline int trace_take_tail(trace_t *t, const char *end)
+{
+  size_t tail_len = (size_t)(end - t->end);
+  if (tail_len == 0)
+    return 0;
+  t->tail = (char *)malloc(tail_len + 1);
+  if (!t->tail)
+    return -1;
+  memcpy(t->tail, t->end, tail_len);
+  t->tail[tail_len] = '\n';
+  t->tail_len = tail_len;
+  t->tail_pending = 1;
+  return 0;
+}
+
+/* Streaming: points end past the data (binary) or the last complete line (text). */
+static inline int trace_bound(trace_t *t)
+{
+  const char *data_end = t->window + t->window_len;
+  t->data = t->window;
+  t->end = data_end;
+  if (t->binary)
+    return 0;
+  while (t->end > t->cur && t->end[-1] != '\n')
+    --t->end;
+  return t->eof ? trace_take_tail(t, data_end) : 0;
+}
+
+/*
+ * Streaming: keeps the unread bytes, reads until the window is full or the
+ * input ends, and sets end past the last complete line (text) or all data
+ * (binary). The window only grows for a text line longer than itself.
+ * Returns 0 on success, -1 on a read or allocation error.
+ */
+static inline int trace_fill(trace_t *t)
+{
+  for (;;)
+  {
+    size_t keep = t->window_len - (size_t)(t->cur - t->window);
+    t->consumed += (unsigned long long)(t->cur - t->window);
+    memmove(t->window, t->cur, keep);
+    t->cur = t->window;
+    t->window_len = keep;
+    if (keep == t->window_cap)
+    {
+      char *grown = (char *)realloc(t->window, t->window_cap * 2);
+      if (!grown)
+        return -1;
+      t->window = grown;
+      t->window_cap *= 2;
+      t->cur = t->window;
+    }
+    while (!t->eof && t->window_len < t->window_cap)
+    {
+      ssize_t n = read(t->fd, t->window + t->window_len, t->window_cap - t->window_len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return -1;
+      if (n == 0)
+        t->eof = 1;
+      unsigned long long at = t->consumed + t->window_len;
+      if (at < TRACE_HEAD_LEN)
+      {
+        size_t k = (size_t)n < TRACE_HEAD_LEN - at ? (size_t)n : (size_t)(TRACE_HEAD_LEN - at);
+        memcpy(t->head + at, t->window + t->window_len, k);
+        t->head_len = (size_t)at + k;
+      }
+      t->window_len += (size_t)n;
+    }
+    if (trace_bound(t) != 0)
+      return -1;
+    if (t->binary || t->eof || t->end > t->cur)
+      return 0;
+  }
+}
+
+/* Returns 0 on success, -1 if the file cannot be read, -2 for an unsupported binary version. */
+static inline int trace_open(trace_t *t, const char *path)
+{
+  memset(t, 0, sizeof(*t));
+  int fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode))
+  {
+    close(fd);
+    return -1;
+  }
+  if (!S_ISREG(st.st_mode))
+  {
+    t->stream = 1;
+    t->fd = fd;
+    t->window_cap = TRACE_STREAM_WINDOW;
+    t->window = (char *)malloc(t->window_cap);
+    t->cur = t->window;
+    t->binary = 1; /* take raw bytes until the header has been checked */
+    if (!t->window || trace_fill(t) != 0)
+    {
+      free(t->window);
+      close(fd);
+      return -1;
+    }
+    t->binary = trace_is_binary(t->window, t->window_len);
+    if (t->binary)
+    {
+      if ((unsigned char)t->window[4] != TRACE_BIN_VERSION)
+      {
+        free(t->window);
+        close(fd);
+        return -2;
+      }
+      t->cur = t->window + TRACE_BIN_HEADER_LEN;
+      trace_codec_init(&t->codec);
+      return 0;
+    }
+    if (trace_bound(t) != 0 || (!t->eof && t->end == t->cur && trace_fill(t) != 0))
+    {
+      free(t->window);
+      close(fd);
+      return -1;
+    }
+    return 0;
+  }
+  size_t len = (size_t)st.st_size;
+  if (len > 0)
+  {
+    void *m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED)
+    {
+      close(fd);
+      return -1;
+    }
+    posix_madvise(m, len, POSIX_MADV_SEQUENTIAL);
+    t->data = (const char *)m;
+    t->map_len = len;
+  }
+  close(fd);
+
+  if (trace_is_binary(t->data, len))
+  {
+    if ((unsigned char)t->data[4] != TRACE_BIN_VERSION)
+    {
+      munmap((void *)t->data, t->map_len);
+      return -2;
+    }
+    t->binary = 1;
+    t->cur = t->data + TRACE_BIN_HEADER_LEN;
+    t->end = t->data + len;
+    trace_codec_init(&t->codec);
+    return 0;
+  }
+
+  size_t body_len = len;
+  while (body_len > 0 && t->data[body_len - 1] != '\n')
+    --body_len;
+  t->cur = t->data;
+  t->end = t->data + body_len;
+  if (trace_take_tail(t, t->data + len) != 0)
+  {
+    munmap((void *)t->data, t->map_len);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Returns 1 and fills rec while records remain, 0 at end of trace. A read
+ * error on a stream also ends the trace.
+ */
+static inline int trace_next(trace_t *t, trace_rec_t *rec)
+{
+  if (t->binary)
+  {
+    for (;;)
+    {
+      const unsigned char *p = trace_decode(&t->codec, (const unsigned char *)t->cur,
+                                            (const unsigned char *)t->end, rec);
+      if (p)
+      {
+        t->cur = (const char *)p;
+        return 1;
+      }
+      /* a record cut off by the window; the codec only advances on success, so retry after refilling */
+      if (!t->stream || t->eof || t->end - t->cur >= TRACE_BIN_MAX_REC || trace_fill(t) != 0)
+        return 0;
+    }
+  }
+  for (;;)
+  {
+    if (t->cur < t->end)
+    {
+      t->cur = trace_parse_line(trace_char_class(), t->cur, rec);
+      return 1;
+    }
+    if (!t->stream || t->eof || trace_fill(t) != 0)
+      break;
+  }
+  if (t->tail_pending)
+  {
+    t->tail_pending = 0;
+    trace_parse_line(trace_char_class(), t->tail, rec);
+    return 1;
+  }
+  return 0;
+}
+
+static inline void trace_tell(const trace_t *t, trace_pos_t *pos)
+{
+  pos->codec = t->codec;
+  if (t->stream)
+    pos->offset = t->consumed + (unsigned long long)(t->cur - t->window);
+  else
+    pos->offset = (unsigned long long)(t->cur - t->data);
+  if (t->tail && !t->tail_pending)
+    pos->offset += t->tail_len;
+}
+
+/*
+ * Moves to a position taken by trace_tell() on the same input. Mapped
+ * traces jump there; streams decode and drop the records before it.
+ * Returns 0, or -1 if the input ends first or does not line up.
+ */
+static inline int trace_seek(trace_t *t, const trace_pos_t *pos)
+{
+  trace_pos_t here;
+  if (!t->stream)
+  {
+    size_t body_len = (size_t)(t->end - t->data);
+    if (pos->offset > body_len + t->tail_len || (t->binary && pos->offset < TRACE_BIN_HEADER_LEN))
+      return -1;
+    t->cur = t->data + (pos->offset < body_len ? pos->offset : body_len);
+    t->tail_pending = t->tail && pos->offset <= body_len;
+    t->codec = pos->codec;
+    return 0;
+  }
+  trace_rec_t rec;
+  for (trace_tell(t, &here); here.offset < pos->offset; trace_tell(t, &here))
+    if (!trace_next(t, &rec))
+      return -1;
+  return here.offset == pos->offset ? 0 : -1;
+}
+
+/* The first bytes of the input read so far, at most TRACE_HEAD_LEN of them; *len gets their number. */
+static inline const char *trace_head(const trace_t *t, size_t *len)
+{
+  if (t->stream)
+  {
+    *len = t->head_len;
+    return t->head;
+  }
+  *len = t->map_len < TRACE_HEAD_LEN ? t->map_len : TRACE_HEAD_LEN;
+  return t->data;
+}
+
+/* Size in bytes of a mapped trace, or TRACE_SIZE_UNKNOWN for streams. */
+static inline unsigned long long trace_size(const trace_t *t)
+{
+  return t->stream ? TRACE_SIZE_UNKNOWN : (unsigned long long)t->map_len;
+}
+
+/* Fraction of a mapped trace consumed so far, or -1 for streams. */
+static inline double trace_fraction(const trace_t *t)
+{
+  if (t->stream || t->map_len == 0)
+    return -1.0;
+  return (double)(t->cur - t->data) / (double)t->map_len;
+}
+
+static inline void trace_close(trace_t *t)
+{
+  if (t->map_len)
+    munmap((void *)t->data, t->map_len);
+  if (t->stream)
+  {
+    free(t->window);
+    close(t->fd);
+  }
+  free(t->tail);
+}
@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "trace.h"
+
+void printHelp(const char *name)
+{
+  printf(
+      "Usage: %s [-h] [-b | -t] <input> <output>\n"
+      "Converts between text and binary traces. The input format is detected\n"
+      "automatically; by default the other format is written.\n"
+      "Options:\n"
+      "  -h         Print this help message.\n"
+      "  -b         Write a binary trace.\n"
+      "  -t         Write a text trace.\n"
+      "  <input>    Input file, or - for stdin.\n"
+      "  <output>   Output file, or - for stdout.\n\n"
+      "Examples:\n"
+      "  linux>  %s traces/yi.trace yi.bin\n"
+      "  linux>  %s -t yi.bin -\n",
+      name, name, name);
+}
+
+int main(int argc, char *argv[])
+{
+  int to_binary = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "hbt")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h':
+      printHelp(argv[0]);
+      return 0;
+    case 'b':
+      to_binary = 1;
+      break;
+    case 't':
+      to_binary = 0;
+      break;
+    default:
+      printHelp(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - optind != 2)
+  {
+    printHelp(argv[0]);
+    return 1;
+  }
+  const char *in_file = argv[optind];
+  const char *out_file = argv[optind + 1];
+
+  trace_t trace;
+  int trace_err = trace_open(&trace, in_file);
+  if (trace_err != 0)
+  {
+    if (trace_err == -2)
+      fprintf(stderr, "Unsupported binary trace version: %s\n", in_file);
+    else
+      fprintf(stderr, "Cannot open trace file: %s\n", in_file);
+    return 1;
+  }
+  if (to_binary == -1)
+    to_binary = !trace.binary;
+
+  FILE *out = strcmp(out_file, "-") == 0 ? stdout : fopen(out_file, "wb");
+  if (!out)
+  {
+    fprintf(stderr, "Cannot open output file: %s\n", out_file);
+    trace_close(&trace);
+    return 1;
+  }
+
+  static char buf[1 << 16];
+  size_t used = 0;
+  trace_codec_t codec;
+  trace_codec_init(&codec);
+  if (to_binary)
+  {
+    trace_bin_header((unsigned char *)buf);
+    used = TRACE_BIN_HEADER_LEN;
+  }
+
+  trace_rec_t rec;
+  while (trace_next(&trace, &rec))
+  {
+    if (rec.op == 0)
+      continue;
+    if (used + TRACE_LINE_MAX > sizeof(buf))
+    {
+      fwrite(buf, 1, used, out);
+      used = 0;
+    }
+    if (to_binary)
+      used += trace_encode(&codec, &rec, (unsigned char *)buf + used);
+    else
+      used += trace_format_line(&rec, buf + used);
+  }
+  fwrite(buf, 1, used, out);
+
+  trace_close(&trace);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
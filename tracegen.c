@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "trace.h"
+
+/* Matrices start where printTrace puts them: A (m x n), then B (n x p), then C (m x p). */
+#define GEN_BASE 0x30000000ULL
+
+void printHelp(const char *name)
+{
+  printf(
+      "Usage: %s [-hb] [-n <num>] [-w <bytes>] [-k <bytes>] [-a <alpha>] [-e <bytes>]\n"
+      "       [-r <frac>] [-x <seed>] <pattern> <output>\n"
+      "Writes a synthetic trace.\n"
+      "Patterns:\n"
+      "  seq           num accesses walking the working set, wrapping around.\n"
+      "  stride        Likewise, k bytes apart.\n"
+      "  random        num accesses uniform over the working set.\n"
+      "  zipf          num accesses whose element ranks follow Zipf(alpha); the\n"
+      "                hot elements are scattered over the working set.\n"
+      "  transpose:N   B = A^T for N x N matrices of ints, reading A by rows.\n"
+      "  gemm:M,N,P    C += A * B, naive i-j-k order, with the printTrace layout\n"
+      "                (csim -a M,N,P,0 breaks results down by matrix).\n"
+      "Options:\n"
+      "  -h         Print this help message.\n"
+      "  -b         Write a binary trace (default text).\n"
+      "  -n <num>   Accesses for the stream patterns (default 1000000).\n"
+      "  -w <bytes> Working set of the stream patterns (default 1 MiB; k, M, G\n"
+      "             suffixes allowed).\n"
+      "  -k <bytes> Stride (default 64).\n"
+      "  -a <alpha> Zipf exponent (default 1.0).\n"
+      "  -e <bytes> Element size (default 4).\n"
+      "  -r <frac>  Fraction of stream accesses that are stores (default 0).\n"
+      "  -x <seed>  Random seed (default 1).\n"
+      "  <output>   Output file, or - for stdout.\n\n"
+      "Examples:\n"
+      "  linux>  %s -n 10000000 -w 64M random random.trace\n"
+      "  linux>  %s -b -a 0.9 -w 16M zipf zipf.bin\n"
+      "  linux>  %s gemm:64,64,64 - | ./csim -s 5 -E 1 -b 5\n",
+      name, name, name, name);
+}
+
+typedef struct
+{
+  FILE *out;
+  int binary;
+  trace_codec_t codec;
+  size_t used;
+  unsigned char buf[1 << 16];
+} writer_t;
+
+static void emit(writer_t *w, char op, unsigned long long addr, int size)
+{
+  if (w->used + TRACE_LINE_MAX > sizeof(w->buf))
+  {
+    fwrite(w->buf, 1, w->used, w->out);
+    w->used = 0;
+  }
+  trace_rec_t rec = {op, size, TRACE_REG_NONE, addr, -1, TRACE_TIME_NONE};
+  if (w->binary)
+    w->used += trace_encode(&w->codec, &rec, w->buf + w->used);
+  else
+    w->used += trace_format_line(&rec, (char *)w->buf + w->used);
+}
+
+static unsigned long long rng_next(unsigned long long *state)
+{
+  /* splitmix64 */
+  unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1). */
+static double rng_unit(unsigned long long *state)
+{
+  return (double)(rng_next(state) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * Zipf sampling by rejection-inversion (Hoermann and Derflinger, 1996):
+ * constant expected time per draw and no table, so the working set can be
+ * large.
+ */
+typedef struct
+{
+  double alpha, h_x1, h_n, s;
+  unsigned long long n;
+} zipf_t;
+
+/* log1p(x) / x and expm1(x) / x, continuous at 0 */
+static double log1p_div(double x)
+{
+  return fabs(x) > 1e-8 ? log1p(x) / x : 1.0 - x / 2.0;
+}
+
+static double expm1_div(double x)
+{
+  return fabs(x) > 1e-8 ? expm1(x) / x : 1.0 + x / 2.0;
+}
+
+static double zipf_h(const zipf_t *z, double x)
+{
+  return exp(-z->alpha * log(x));
+}
+
+/* Integral of x^-alpha, shifted so that it is continuous in alpha. */
+static double zipf_hint(const zipf_t *z, double x)
+{
+  double lx = log(x);
+  return expm1_div((1.0 - z->alpha) * lx) * lx;
+}
+
+static double zipf_hint_inv(const zipf_t *z, double x)
+{
+  double t = x * (1.0 - z->alpha);
+  if (t < -1.0)
+    t = -1.0;
+  return exp(log1p_div(t) * x);
+}
+
+static void zipf_init(zipf_t *z, unsigned long long n, double alpha)
+{
+  z->n = n;
+  z->alpha = alpha;
+  z->h_x1 = zipf_hint(z, 1.5) - 1.0;
+  z->h_n = zipf_hint(z, (double)n + 0.5);
+  z->s = 2.0 - zipf_hint_inv(z, zipf_hint(z, 2.5) - zipf_h(z, 2.0));
+}
+
+/* A rank in [1, n]; rank k has weight k^-alpha. */
+static unsigned long long zipf_next(const zipf_t *z, unsigned long long *rng)
+{
+  for (;;)
+  {
+    double u = z->h_n + rng_unit(rng) * (z->h_x1 - z->h_n);
+    double x = zipf_hint_inv(z, u);
+    double k = floor(x + 0.5);
+    if (k < 1.0)
+      k = 1.0;
+    else if (k > (double)z->n)
+      k = (double)z->n;
+    if (k - x <= z->s || u >= zipf_hint(z, k + 0.5) - zipf_h(z, k))
+      return (unsigned long long)k;
+  }
+}
+
+static unsigned long long gcd(unsigned long long a, unsigned long long b)
+{
+  while (b)
+  {
+    unsigned long long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* Parses a byte count with an optional k, M or G suffix. Returns 0 on failure. */
+static unsigned long long parse_bytes(const char *arg)
+{
+  char *end;
+  unsigned long long v = strtoull(arg, &end, 0);
+  int shift = 0;
+  if (*end == 'k' || *end == 'K')
+    shift = 10;
+  else if (*end == 'm' || *end == 'M')
+    shift = 20;
+  else if (*end == 'g' || *end == 'G')
+    shift = 30;
+  if (shift)
+    ++end;
+  return *end ? 0 : v << shift;
+}
+
+int main(int argc, char *argv[])
+{
+  int binary = 0;
+  unsigned long long count = 1000000, working_set = 1 << 20, stride = 64, seed = 1;
+  double alpha = 1.0, store_frac = 0.0;
+  int elem = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "hbn:w:k:a:e:r:x:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'h':
+      printHelp(argv[0]);
+      return 0;
+    case 'b':
+      binary = 1;
+      break;
+    case 'n':
+      count = strtoull(optarg, NULL, 0);
+      break;
+    case 'w':
+      working_set = parse_bytes(optarg);
+      break;
+    case 'k':
+      stride = parse_bytes(optarg);
+      break;
+    case 'a':
+      alpha = strtod(optarg, NULL);
+      break;
+    case 'e':
+      elem = atoi(optarg);
+      break;
+    case 'r':
+      store_frac = strtod(optarg, NULL);
+      break;
+    case 'x':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      printHelp(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - optind != 2 || working_set == 0 || stride == 0 || elem <= 0 || alpha <= 0.0 ||
+      (unsigned long long)elem > working_set)
+  {
+    printHelp(argv[0]);
+    return 1;
+  }
+  const char *pattern = argv[optind];
+  const char *out_file = argv[optind + 1];
+
+  enum
+  {
+    GEN_SEQ,
+    GEN_STRIDE,
+    GEN_RANDOM,
+    GEN_ZIPF,
+    GEN_TRANSPOSE,
+    GEN_GEMM
+  } kind;
+  unsigned long long dim[3] = {0, 0, 0};
+  char extra;
+  if (strcmp(pattern, "seq") == 0)
+    kind = GEN_SEQ;
+  else if (strcmp(pattern, "stride") == 0)
+    kind = GEN_STRIDE;
+  else if (strcmp(pattern, "random") == 0)
+    kind = GEN_RANDOM;
+  else if (strcmp(pattern, "zipf") == 0)
+    kind = GEN_ZIPF;
+  else if (sscanf(pattern, "transpose:%llu%c", &dim[0], &extra) == 1 && dim[0] > 0)
+    kind = GEN_TRANSPOSE;
+  else if (sscanf(pattern, "gemm:%llu,%llu,%llu%c", &dim[0], &dim[1], &dim[2], &extra) == 3 && dim[0] > 0 &&
+           dim[1] > 0 && dim[2] > 0)
+    kind = GEN_GEMM;
+  else
+  {
+    fprintf(stderr, "Unknown pattern: %s\n", pattern);
+    return 1;
+  }
+
+  static writer_t w;
+  w.out = strcmp(out_file, "-") == 0 ? stdout : fopen(out_file, "wb");
+  if (!w.out)
+  {
+    fprintf(stderr, "Cannot open output file: %s\n", out_file);
+    return 1;
+  }
+  w.binary = binary;
+  trace_codec_init(&w.codec);
+  if (binary)
+  {
+    trace_bin_header(w.buf);
+    w.used = TRACE_BIN_HEADER_LEN;
+  }
+
+  unsigned long long rng = seed;
+  unsigned long long elems = working_set / (unsigned long long)elem;
+  /* zipf ranks go through a bijection of the elements, so the hot ones are spread out */
+  unsigned long long scatter = (unsigned long long)((double)elems * 0.6180339887) | 1;
+  while (gcd(scatter, elems) != 1)
+    scatter += 2;
+  zipf_t zipf;
+  if (kind == GEN_ZIPF)
+    zipf_init(&zipf, elems, alpha);
+
+  switch (kind)
+  {
+  case GEN_SEQ:
+  case GEN_STRIDE:
+  case GEN_RANDOM:
+  case GEN_ZIPF:
+  {
+    unsigned long long step = kind == GEN_SEQ ? (unsigned long long)elem : stride;
+    unsigned long long offset = 0;
+    for (unsigned long long i = 0; i < count; ++i)
+    {
+      if (kind == GEN_RANDOM)
+        offset = rng_next(&rng) % elems * (unsigned long long)elem;
+      else if (kind == GEN_ZIPF)
+        offset = (zipf_next(&zipf, &rng) - 1) * scatter % elems * (unsigned long long)elem;
+      char op = store_frac > 0.0 && rng_unit(&rng) < store_frac ? 'S' : 'L';
+      emit(&w, op, GEN_BASE + offset, elem);
+      if (kind == GEN_SEQ || kind == GEN_STRIDE)
+        offset = (offset + step) % working_set;
+    }
+    break;
+  }
+  case GEN_TRANSPOSE:
+  {
+    unsigned long long n = dim[0], b_base = GEN_BASE + 4 * n * n;
+    for (unsigned long long i = 0; i < n; ++i)
+      for (unsigned long long j = 0; j < n; ++j)
+      {
+        emit(&w, 'L', GEN_BASE + 4 * (i * n + j), 4);
+        emit(&w, 'S', b_base + 4 * (j * n + i), 4);
+      }
+    break;
+  }
+  case GEN_GEMM:
+  {
+    unsigned long long m = dim[0], n = dim[1], p = dim[2];
+    unsigned long long b_base = GEN_BASE + 4 * m * n, c_base = b_base + 4 * n * p;
+    for (unsigned long long i = 0; i < m; ++i)
+      for (unsigned long long j = 0; j < p; ++j)
+      {
+        emit(&w, 'L', c_base + 4 * (i * p + j), 4);
+        for (unsigned long long k = 0; k < n; ++k)
+        {
+          emit(&w, 'L', GEN_BASE + 4 * (i * n + k), 4);
+          emit(&w, 'L', b_base + 4 * (k * p + j), 4);
+        }
+        emit(&w, 'S', c_base + 4 * (i * p + j), 4);
+      }
+    break;
+  }
+  }
+
+  fwrite(w.buf, 1, w.used, w.out);
+  int err = ferror(w.out);
+  if (w.out != stdout)
+    err |= fclose(w.out);
+  if (err)
+  {
+    fprintf(stderr, "Cannot write %s\n", out_file);
+    return 1;
+  }
+  return 0;
+}